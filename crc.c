@@ -0,0 +1,174 @@
+/* crc.c - CRC-32C (Castagnoli) functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* CRC-32C is the checksum used to verify copies, because most processors compute it in hardware: x86 (since SSE4.2) with
+ * its crc32 instruction, and ARMv8 with its crc32c* instructions.  Either way, eight bytes are done per instruction, which
+ * is much faster than a disk can be read.  Whether the processor can do this is determined at run time (by crc_init);
+ * if it cannot, a table-driven implementation (one byte at a time) is used instead.
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#if defined(_M_X64) || defined(__x86_64__)
+#  define CRC_X86
+#  ifdef _MSC_VER
+#    include <intrin.h>     /* __cpuid */
+#  else
+#    include <cpuid.h>      /* __get_cpuid, bit_SSE4_2 */
+#  endif
+#  include <nmmintrin.h>    /* _mm_crc32_u8, _mm_crc32_u64 */
+#elif defined(_M_ARM64) || (defined(__aarch64__) && defined(__linux__))
+#  define CRC_ARM
+#  include <arm_acle.h>     /* __crc32cb, __crc32cd */
+#  ifndef _WIN32
+#    include <sys/auxv.h>   /* AT_HWCAP, getauxval */
+#    include <asm/hwcap.h>  /* HWCAP_CRC32 */
+#  endif
+#endif
+#include <stddef.h>         /* size_t */
+#include <string.h>         /* memcpy */
+#include "crc.h"
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* CRC-32C polynomial (reversed) */
+#define CRC_POLYNOMIAL 0x82F63B78
+
+/* Portable way to let the compiler use the CRC instructions in one function (without requiring them of the whole program) */
+#if defined(_MSC_VER) || !(defined(CRC_X86) || defined(CRC_ARM))
+#  define CRC_TARGET
+#elif defined(CRC_X86)
+#  define CRC_TARGET  __attribute__((target("sse4.2")))
+#else
+#  define CRC_TARGET  __attribute__((target("+crc")))
+#endif
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+unsigned int crc_hardware(unsigned int crc, const unsigned char * p, size_t n);
+unsigned int crc_software(unsigned int crc, const unsigned char * p, size_t n);
+
+
+/*********************
+ * Private Variables *
+ *********************/
+
+/* CRC of each byte value (for crc_software) */
+static unsigned int table[256];
+
+/* Nonzero if the processor computes CRC-32C in hardware */
+static int hardware;
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Prepare to compute CRCs.  (This must be called before crc_update.)
+ */
+void crc_init(void)
+{
+  unsigned int i, j, c;
+#if defined(CRC_X86) && defined(_MSC_VER)
+  int r[4];
+#elif defined(CRC_X86)
+  unsigned int a, b, d;
+#endif
+
+  /* Determine whether the processor can do the work. */
+#if defined(CRC_X86) && defined(_MSC_VER)
+  __cpuid(r, 1);
+  hardware = (r[2] >> 20) & 1;
+#elif defined(CRC_X86)
+  hardware = __get_cpuid(1, &a, &b, &c, &d) && (c & bit_SSE4_2);
+#elif defined(CRC_ARM) && defined(_WIN32)
+  hardware = 1;
+#elif defined(CRC_ARM)
+  hardware = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#endif
+
+  /* Either way, build the table (which is small enough not to matter). */
+  for (i = 0; i < 256; ++i)
+  {
+    for (c = i, j = 0; j < 8; ++j) c = (c & 1) ? (c >> 1) ^ CRC_POLYNOMIAL : c >> 1;
+    table[i] = c;
+  }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Update a CRC with more data.
+ *   crc:  CRC of the data so far (or zero, if there is none)
+ *   data:  more data
+ *   size:  size (in bytes) of data
+ * Return Value:  CRC of the data so far, followed by the new data.
+ */
+unsigned int crc_update(unsigned int crc, const void * data, size_t size)
+{
+  const unsigned char * p = (const unsigned char *)data;
+
+  return ~(hardware ? crc_hardware(~crc, p, size) : crc_software(~crc, p, size));
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compute a (raw, i.e., not inverted) CRC using the processor's CRC instructions, eight bytes at a time.
+ *   crc:  CRC so far
+ *   p:  data
+ *   n:  size (in bytes) of data
+ * Return Value:  Updated CRC.
+ */
+CRC_TARGET unsigned int crc_hardware(unsigned int crc, const unsigned char * p, size_t n)
+{
+#if defined(CRC_X86) || defined(CRC_ARM)
+  unsigned long long c = crc, x;
+
+  for (; n >= 8; p += 8, n -= 8)
+  {
+    memcpy(&x, p, 8);
+#  ifdef CRC_X86
+    c = _mm_crc32_u64(c, x);
+#  else
+    c = __crc32cd((unsigned int)c, x);
+#  endif
+  }
+#  ifdef CRC_X86
+  for (; n; --n) c = _mm_crc32_u8((unsigned int)c, *p++);
+#  else
+  for (; n; --n) c = __crc32cb((unsigned int)c, *p++);
+#  endif
+  return (unsigned int)c;
+#else
+  return crc_software(crc, p, n);
+#endif
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compute a (raw, i.e., not inverted) CRC using the table, one byte at a time.
+ *   crc:  CRC so far
+ *   p:  data
+ *   n:  size (in bytes) of data
+ * Return Value:  Updated CRC.
+ */
+unsigned int crc_software(unsigned int crc, const unsigned char * p, size_t n)
+{
+  for (; n; --n) crc = (crc >> 8) ^ table[(crc ^ *p++) & 0xFF];
+  return crc;
+}
@@ -0,0 +1,33 @@
+/* crc.h - CRC-32C (Castagnoli) functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _CRC_H_
+#define _CRC_H_
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include <stddef.h>  /* size_t */
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+void crc_init(void);
+unsigned int crc_update(unsigned int crc, const void * data, size_t size);
+
+
+#endif  /* (prevent multiple inclusion) */
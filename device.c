@@ -0,0 +1,294 @@
+/* device.c - per-device scheduling functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* When the files to sync span several devices (e.g., mount points nested under SOURCE or DEST), one limit on the number of
+ * threads cannot suit them all: enough threads to keep a fast device busy will overload a slow one, and then every thread
+ * ends up waiting on the slow one while the fast one sits idle.  So each device (as identified by st_dev) is given its own
+ * limit on the number of copies in flight to or from it, and the files to copy are queued by the set of devices they touch.
+ * Each thread takes the next file from whichever queue (in turn) has all of its devices below their limits, and waits only
+ * when none does.  With a limit of zero (i.e., auto), each device's limit is tuned separately, by its own throughput (bytes
+ * copied to or from it per second), in the same way that tune.c tunes the number of threads (see tune_adjust).
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#ifdef _WIN32
+#  include <windows.h>  /* CONDITION_VARIABLE, CRITICAL_SECTION, *ConditionVariable*, *CriticalSection */
+#else
+#  include <pthread.h>  /* pthread_* */
+#endif
+#include <stdlib.h>     /* free, malloc */
+#include <stdio.h>      /* perror */
+#include "device.h"     /* DEVICE_MAX_COUNT */
+#include "limit.h"      /* limit_clock */
+#include "tune.h"       /* (struct) tuning, tune_adjust, TUNE_INTERVAL, TUNE_START_JOBS */
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Portable locks and condition variables */
+#ifdef _WIN32
+#  define LOCK                     CRITICAL_SECTION
+#  define LOCK_INIT(l)             InitializeCriticalSection(&(l))
+#  define LOCK_ACQUIRE(l)          EnterCriticalSection(&(l))
+#  define LOCK_RELEASE(l)          LeaveCriticalSection(&(l))
+#  define CONDITION                CONDITION_VARIABLE
+#  define CONDITION_INIT(c)        InitializeConditionVariable(&(c))
+#  define CONDITION_WAIT(c, l)     SleepConditionVariableCS(&(c), &(l), INFINITE)
+#  define CONDITION_BROADCAST(c)   WakeAllConditionVariable(&(c))
+#else
+#  define LOCK                     pthread_mutex_t
+#  define LOCK_INIT(l)             pthread_mutex_init(&(l), NULL)
+#  define LOCK_ACQUIRE(l)          pthread_mutex_lock(&(l))
+#  define LOCK_RELEASE(l)          pthread_mutex_unlock(&(l))
+#  define CONDITION                pthread_cond_t
+#  define CONDITION_INIT(c)        pthread_cond_init(&(c), NULL)
+#  define CONDITION_WAIT(c, l)     pthread_cond_wait(&(c), &(l))
+#  define CONDITION_BROADCAST(c)   pthread_cond_broadcast(&(c))
+#endif
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* A device, and the copies in flight to or from it */
+struct device
+{
+  unsigned long long id;  /* device ID (st_dev) */
+  int busy;               /* number of copies in flight */
+  long long bytes;        /* number of bytes copied to or from the device so far */
+  long long sampled;      /* number of bytes copied as of the last sample (see device_sample) */
+  struct tuning tuning;   /* limit on the number of copies in flight (jobs member), and how it is tuned */
+};
+
+/* Queue of files to copy that touch the same set of devices */
+struct device_queue
+{
+  unsigned long long mask;  /* set of devices (bit i for device i) */
+  int head;                 /* index (into order) of next file to claim */
+  int end;                  /* index (into order) just past the last file in the queue */
+};
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+int device_ready(unsigned long long mask);
+void device_sample(void);
+
+
+/*********************
+ * Private Variables *
+ *********************/
+
+/* State of the scheduling (started by device_start) */
+static struct
+{
+  int jobs;                                    /* limit on copies in flight per device (or zero, if tuned) */
+  int max_jobs;                                /* number of threads started (and the most that a limit is tuned to) */
+  LOCK lock;                                   /* protects the members below */
+  CONDITION ready;                             /* signaled when a copy finishes (so that its devices may take another) */
+  struct device devices[DEVICE_MAX_COUNT];     /* devices found so far */
+  int count;                                   /* number of items in devices */
+  const unsigned long long * masks;            /* set of devices touched by each file of the current run */
+  int * order;                                 /* indices of the files of the current run, grouped by queue (or NULL) */
+  struct device_queue * queues;                /* queues of the current run */
+  int queue_count;                             /* number of items in queues */
+  int last;                                    /* index of the queue from which a file was last claimed */
+  long long next;                              /* time (in nanoseconds) at which to take the next sample (if tuning) */
+  long long sampled;                           /* time (in nanoseconds) at which the last sample was taken */
+} state;
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Start scheduling copies by device.
+ *   jobs:  number of copies that may be in flight to or from each device (or, if zero, however many turn out to be fastest)
+ *   max_jobs:  number of threads started (see work_start)
+ */
+void device_start(int jobs, int max_jobs)
+{
+  LOCK_INIT(state.lock);
+  CONDITION_INIT(state.ready);
+  state.jobs = jobs;
+  state.max_jobs = max_jobs;
+  state.sampled = limit_clock();
+  state.next = state.sampled + TUNE_INTERVAL;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Find a device (adding it, if it has not been found before).  This may be called by any thread.
+ *   id:  device ID (st_dev)
+ * Return Value:  Index of device (less than DEVICE_MAX_COUNT).
+ */
+int device_find(unsigned long long id)
+{
+  struct device * p;
+  int i;
+
+  LOCK_ACQUIRE(state.lock);
+  for (i = 0; i < state.count && state.devices[i].id != id; ++i);
+  if (i == state.count && i < DEVICE_MAX_COUNT)
+  {
+    p = &state.devices[state.count++];
+    p->id = id;
+    p->tuning.jobs = !state.jobs ? ((state.max_jobs < TUNE_START_JOBS) ? state.max_jobs : TUNE_START_JOBS) : state.jobs;
+  }
+  LOCK_RELEASE(state.lock);
+  return (i < DEVICE_MAX_COUNT) ? i : DEVICE_MAX_COUNT - 1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Queue the files of a run (before work_run), by the set of devices that each one touches.  (The files are then claimed by
+ * device_claim, and each must be passed to device_done once it has been copied.)
+ *   masks:  set of devices (bit i for device i) touched by each file (which must remain valid for the rest of the run)
+ *   count:  number of files
+ * Return Value:  Zero on success; otherwise (if the files cannot be queued, and so are claimed in order), nonzero.
+ */
+int device_queue(const unsigned long long * masks, int count)
+{
+  int i, j, n;
+
+  /* Free the queues of the last run. */
+  free(state.order);
+  free(state.queues);
+  state.order = NULL;
+  state.queues = NULL;
+  state.queue_count = 0;
+  state.last = -1;
+  state.masks = masks;
+  if (!(state.order = (int *)malloc((count + 1) * sizeof(int))) ||
+      !(state.queues = (struct device_queue *)malloc((count + 1) * sizeof(struct device_queue))))
+  {
+    perror("malloc"); free(state.order); state.order = NULL; return -1;
+  }
+
+  /* Count the files in each queue (adding a queue for each set of devices not seen before). */
+  for (i = 0; i < count; ++i)
+  {
+    for (j = 0; j < state.queue_count && state.queues[j].mask != masks[i]; ++j);
+    if (j == state.queue_count) { state.queues[j].mask = masks[i]; state.queues[j].end = 0; ++state.queue_count; }
+    ++state.queues[j].end;
+  }
+
+  /* Lay the queues out one after another (so that each file keeps its place in line within its queue). */
+  for (j = n = 0; j < state.queue_count; ++j) { state.queues[j].head = n; n += state.queues[j].end; state.queues[j].end = state.queues[j].head; }
+  for (i = 0; i < count; ++i)
+  {
+    for (j = 0; state.queues[j].mask != masks[i]; ++j);
+    state.order[state.queues[j].end++] = i;
+  }
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Claim the next file to copy (waiting, if need be, until some queue's devices are all below their limits).  This is meant to
+ * be called by a work_function, once for each index of the run; the file it returns may not be the one with that index.
+ *   index:  index passed to the work_function
+ * Return Value:  Index of the file to copy.
+ */
+int device_claim(int index)
+{
+  struct device_queue * q;
+  int i, j;
+
+  /* If the files of this run are not queued, just claim them in order. */
+  if (!state.order) return index;
+
+  /* Find the next queue (after the last one claimed from) that has a file to claim, and whose devices are all ready. */
+  LOCK_ACQUIRE(state.lock);
+  for (;;)
+  {
+    for (i = 0, q = NULL; i < state.queue_count; ++i)
+    {
+      q = &state.queues[j = (state.last + 1 + i) % state.queue_count];
+      if (q->head < q->end && device_ready(q->mask)) break;
+    }
+    if (i < state.queue_count) break;
+    CONDITION_WAIT(state.ready, state.lock);
+  }
+
+  /* Claim its next file, which puts another copy in flight on each of its devices. */
+  state.last = j;
+  index = state.order[q->head++];
+  for (i = 0; i < state.count; ++i) if (q->mask >> i & 1) ++state.devices[i].busy;
+  LOCK_RELEASE(state.lock);
+  return index;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Finish copying a file claimed by device_claim (freeing up its devices for another).
+ *   index:  index of file (as returned by device_claim)
+ *   bytes:  number of bytes copied (which counts toward the throughput of each of the file's devices)
+ */
+void device_done(int index, double bytes)
+{
+  int i;
+
+  if (!state.order) return;
+  LOCK_ACQUIRE(state.lock);
+  for (i = 0; i < state.count; ++i)
+  {
+    if (!(state.masks[index] >> i & 1)) continue;
+    --state.devices[i].busy;
+    state.devices[i].bytes += (long long)bytes;
+  }
+  if (!state.jobs) device_sample();
+  CONDITION_BROADCAST(state.ready);
+  LOCK_RELEASE(state.lock);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Determine whether each of a set of devices can take another copy.  (The caller must hold the lock.)
+ *   mask:  set of devices (bit i for device i)
+ * Return Value:  Nonzero if every device in the set is below its limit; otherwise, zero.
+ */
+int device_ready(unsigned long long mask)
+{
+  int i;
+
+  for (i = 0; i < state.count; ++i) if ((mask >> i & 1) && state.devices[i].busy >= state.devices[i].tuning.jobs) return 0;
+  return 1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * If it is time, sample the throughput of each device (and tune its limit accordingly).  (The caller must hold the lock.)
+ * Bytes count toward throughput only once their file is copied, so a device that finished no copies since the last sample
+ * is left alone (lest one that is in the middle of a large file, or simply has nothing left to do, seem to be overloaded).
+ */
+void device_sample(void)
+{
+  struct device * p;
+  long long now = limit_clock();
+  int i;
+
+  if (now < state.next) return;
+  for (i = 0; i < state.count; ++i)
+  {
+    p = &state.devices[i];
+    if (p->bytes == p->sampled) continue;
+    tune_adjust(&p->tuning, (p->bytes - p->sampled) * 1e9 / (now - state.sampled), state.max_jobs);
+    p->sampled = p->bytes;
+  }
+  state.sampled = now;
+  state.next = now + TUNE_INTERVAL;
+}
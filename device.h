@@ -0,0 +1,37 @@
+/* device.h - per-device scheduling functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _DEVICE_H_
+#define _DEVICE_H_
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Maximum number of devices that are scheduled separately.  (Any others share the last one's queue and limit.) */
+#define DEVICE_MAX_COUNT 64
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+void device_start(int jobs, int max_jobs);
+int device_find(unsigned long long id);
+int device_queue(const unsigned long long * masks, int count);
+int device_claim(int index);
+void device_done(int index, double bytes);
+
+
+#endif  /* (prevent multiple inclusion) */
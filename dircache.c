@@ -0,0 +1,243 @@
+/* dircache.c - directory cache functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* A directory cache is a text file recording each destination directory that had nothing to purge (see --dir-cache),
+ * along with the modification times of it and of the corresponding source directory at the time.  A directory's time
+ * changes whenever an entry is added to it, removed from it, or renamed; so if neither time has changed since, there is
+ * still nothing to purge in the destination directory (apart from its subdirectories, which have records of their own).
+ * Each line is the two times (in nanoseconds since 1970) and the absolute pathname of the destination directory.  The
+ * cache file is replaced with the records of the directories found to have nothing to purge each time.
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#ifdef _WIN32
+/* This eliminates deprecation warnings for functions that are considered "unsafe" (and would
+ * result in error C4996) on Win32, thus allowing us to write simpler, more portable code.
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <errno.h>     /* ENOENT, errno */
+#include <stdio.h>     /* fclose, fgets, FILE, fopen, fprintf, perror */
+#include <stdlib.h>    /* bsearch, calloc, free, malloc, qsort, realloc, strtoll */
+#include <string.h>    /* memcpy, strcmp, strlen */
+#include "jb.h"        /* JB_PATH_MAX_LENGTH */
+#include "dircache.h"  /* (struct) dircache, (struct) dircache_entry */
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+int dircache_load(struct dircache * cache, FILE * f);
+int dircache_add(struct dircache_entry ** entries_ptr, int * count_ptr, int * size_ptr, const char * path,
+                 long long src_mtime, long long dst_mtime);
+void dircache_free(struct dircache_entry * entries, int count);
+int compare_dircache_entries(const void * a, const void * b);
+int find_dircache_entry(const void * key, const void * entry);
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Open a directory cache file (loading the records already in it).  (The file need not exist yet.)
+ *   path:  pathname of cache file
+ * Return Value:  On success, the cache (which should be closed with dircache_close).  Otherwise, NULL.
+ */
+struct dircache * dircache_open(const char * path)
+{
+  struct dircache * cache;
+  size_t n = strlen(path) + 1;
+  FILE * f;
+  int r;
+
+  if (!(cache = (struct dircache *)calloc(1, sizeof(struct dircache)))) { perror("calloc"); return NULL; }
+  if (!(cache->path = (char *)malloc(n))) { perror("malloc"); free(cache); return NULL; }
+  memcpy(cache->path, path, n);
+
+  /* Load the existing records.  (If there is no cache file yet, there are none.) */
+  if (f = fopen(path, "rb"))
+  {
+    r = dircache_load(cache, f);
+    fclose(f);
+    if (r) { free(cache->path); cache->path = NULL; dircache_close(cache); return NULL; }
+  }
+  else if (errno != ENOENT) { perror(path); free(cache->path); free(cache); return NULL; }
+  return cache;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Determine whether a destination directory had nothing to purge the last time, and neither it nor the corresponding source
+ * directory has been modified since.
+ *   cache:  directory cache (opened by dircache_open)
+ *   path:  absolute pathname of destination directory
+ *   src_mtime:  modification time (in nanoseconds since 1970) of source directory
+ *   dst_mtime:  modification time of destination directory
+ * Return Value:  Nonzero if the directory is recorded, with the same times; otherwise, zero.
+ */
+int dircache_find(struct dircache * cache, const char * path, long long src_mtime, long long dst_mtime)
+{
+  struct dircache_entry * e;
+
+  if (!cache->entry_count) return 0;
+  e = (struct dircache_entry *)bsearch(path, cache->entries, cache->entry_count, sizeof(struct dircache_entry),
+                                       find_dircache_entry);
+  return e && e->src_mtime == src_mtime && e->dst_mtime == dst_mtime;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Record a destination directory that had nothing to purge (to be written when the cache is closed).
+ *   cache:  directory cache (opened by dircache_open)
+ *   path:  absolute pathname of destination directory
+ *   src_mtime:  modification time (in nanoseconds since 1970) of source directory
+ *   dst_mtime:  modification time of destination directory
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int dircache_put(struct dircache * cache, const char * path, long long src_mtime, long long dst_mtime)
+{
+  return dircache_add(&cache->puts, &cache->put_count, &cache->put_size, path, src_mtime, dst_mtime);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Close a directory cache (writing the records put in it, sorted by pathname), and free the memory allocated for it.
+ *   cache:  directory cache (opened by dircache_open)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int dircache_close(struct dircache * cache)
+{
+  FILE * f = NULL;
+  int i, r = 0;
+
+  if (cache->path)
+  {
+    qsort(cache->puts, cache->put_count, sizeof(struct dircache_entry), compare_dircache_entries);
+    if (!(f = fopen(cache->path, "wb"))) { perror("fopen"); r = -1; }
+    for (i = 0; f && i < cache->put_count; ++i)
+    {
+      if (fprintf(f, "%lld %lld %s\n", cache->puts[i].src_mtime, cache->puts[i].dst_mtime, cache->puts[i].path) < 0)
+      {
+        perror("fprintf"); r = -1; break;
+      }
+    }
+    if (f && fclose(f)) { perror("fclose"); r = -1; }
+  }
+  dircache_free(cache->entries, cache->entry_count);
+  dircache_free(cache->puts, cache->put_count);
+  free(cache->path);
+  free(cache);
+  return r;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Load the records of a directory cache file (sorted by pathname).  (Lines that are not in the right format are ignored.)
+ *   cache:  directory cache (into which the records are loaded)
+ *   f:  cache file (open for reading)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int dircache_load(struct dircache * cache, FILE * f)
+{
+  char s[JB_PATH_MAX_LENGTH + 48], * p, * q;
+  long long a, b;
+  int n, size_n = 0;
+
+  while (fgets(s, sizeof(s), f))
+  {
+    /* Strip the line break (ignoring a line that was not completely written). */
+    if (!(n = strlen(s)) || s[n - 1] != '\n') continue;
+    s[--n] = '\0';
+    if (n && s[n - 1] == '\r') s[--n] = '\0';
+
+    /* The line must begin with the two times, each followed by a space. */
+    a = strtoll(s, &p, 10);
+    if (p == s || *p != ' ') continue;
+    b = strtoll(++p, &q, 10);
+    if (q == p || *q != ' ' || !*++q) continue;
+    if (dircache_add(&cache->entries, &cache->entry_count, &size_n, q, a, b)) return -1;
+  }
+  qsort(cache->entries, cache->entry_count, sizeof(struct dircache_entry), compare_dircache_entries);
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Add a record to the end of an array (allocating memory for more items, if necessary).
+ *   entries_ptr:  array (which may be reallocated)
+ *   count_ptr:  number of items in array
+ *   size_ptr:  number of items for which memory is allocated
+ *   path:  absolute pathname of destination directory
+ *   src_mtime:  modification time of source directory
+ *   dst_mtime:  modification time of destination directory
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int dircache_add(struct dircache_entry ** entries_ptr, int * count_ptr, int * size_ptr, const char * path,
+                 long long src_mtime, long long dst_mtime)
+{
+  struct dircache_entry * e;
+  size_t n = strlen(path) + 1;
+
+  if (*count_ptr == *size_ptr)
+  {
+    if (!(e = (struct dircache_entry *)realloc(*entries_ptr, (*size_ptr ? *size_ptr * 2 : 256) * sizeof(*e))))
+    {
+      perror("realloc"); return -1;
+    }
+    *entries_ptr = e;
+    *size_ptr = *size_ptr ? *size_ptr * 2 : 256;
+  }
+  e = &(*entries_ptr)[*count_ptr];
+  if (!(e->path = (char *)malloc(n))) { perror("malloc"); return -1; }
+  memcpy(e->path, path, n);
+  e->src_mtime = src_mtime;
+  e->dst_mtime = dst_mtime;
+  ++*count_ptr;
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Free an array of records (and their pathnames).
+ *   entries:  array
+ *   count:  number of items in array
+ */
+void dircache_free(struct dircache_entry * entries, int count)
+{
+  int i;
+
+  for (i = 0; i < count; ++i) free(entries[i].path);
+  free(entries);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare two records by pathname (as a qsort comparison function).
+ *   a:  first record
+ *   b:  second record
+ * Return Value:  Negative, zero, or positive, depending on whether a sorts before, the same as, or after b.
+ */
+int compare_dircache_entries(const void * a, const void * b)
+{
+  return strcmp(((const struct dircache_entry *)a)->path, ((const struct dircache_entry *)b)->path);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare a pathname to a record (as a bsearch comparison function).
+ *   key:  absolute pathname of destination directory
+ *   entry:  record
+ * Return Value:  Negative, zero, or positive, depending on whether the pathname sorts before, the same as, or after the record.
+ */
+int find_dircache_entry(const void * key, const void * entry)
+{
+  return strcmp((const char *)key, ((const struct dircache_entry *)entry)->path);
+}
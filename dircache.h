@@ -0,0 +1,51 @@
+/* dircache.h - directory cache functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _DIRCACHE_H_
+#define _DIRCACHE_H_
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Record of a destination directory that had nothing to purge */
+struct dircache_entry
+{
+  char * path;            /* absolute pathname of destination directory */
+  long long src_mtime;    /* modification time (in nanoseconds since 1970) of corresponding source directory at the time */
+  long long dst_mtime;    /* modification time of destination directory at the time */
+};
+
+struct dircache
+{
+  char * path;                         /* pathname of cache file */
+  struct dircache_entry * entries;     /* records in the cache file, as loaded (sorted by pathname) */
+  int entry_count;                     /* number of entries */
+  struct dircache_entry * puts;        /* records to be written to the cache file (see dircache_put) */
+  int put_count;                       /* number of items in puts */
+  int put_size;                        /* number of items for which memory is allocated */
+};
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+struct dircache * dircache_open(const char * path);
+int dircache_find(struct dircache * cache, const char * path, long long src_mtime, long long dst_mtime);
+int dircache_put(struct dircache * cache, const char * path, long long src_mtime, long long dst_mtime);
+int dircache_close(struct dircache * cache);
+
+
+#endif  /* (prevent multiple inclusion) */
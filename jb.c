@@ -23,14 +23,14 @@
 
 #include <sys/stat.h>  /* mkdir, stat, (struct) stat */
 #include <ctype.h>     /* isspace */
-#include <errno.h>     /* ENOENT, errno */
+#include <errno.h>     /* EEXIST, ENOENT, errno */
 #ifdef _WIN32
 #  include <direct.h>  /* _mkdir */
 #else
 #  include <libgen.h>  /* basename, dirname */
 #endif
 #include <limits.h>    /* INT_MIN */
-#include <stdio.h>     /* fclose, FILE, fopen, fprintf, fwrite, putchar, puts, stderr */
+#include <stdio.h>     /* fclose, FILE, fopen, fprintf, fwrite, getc, putc, putchar, puts, stderr */
 #include <stdlib.h>    /* free, malloc */
 #include <string.h>    /* strcmp, strdup, strlen, strncmp, strrchr */
 #include "jb.h"        /* jb_command_error, (struct) jb_command_option, JB_PATH_SEPARATOR */
@@ -74,6 +74,7 @@ int make_directory(const char * path);
  *   options:  array of jb_command_option structures
  *   option_count:  number of items in options
  *   arg_count:  number of arguments that should follow command line options
+ *     (or, if negative, the minimum number of arguments that should follow them)
  * Return Value:
  *   If INT_MIN, the "help" option was specified on the command line.  Program should terminate with success.
  *   Otherwise, if less than zero, the command line is invalid.  Program should terminate with failure.
@@ -137,7 +138,8 @@ int jb_command_parse(int argc, char * argv[], const char * usage, const char * h
   }
 
   /* Determine if the correct number of arguments follows the options. */
-  if ((n = argc - i) == arg_count) return n;
+  n = argc - i;
+  if ((arg_count < 0) ? (n >= -arg_count) : (n == arg_count)) return n;
   jb_command_error(argv[0], usage); return -1;
 }
 
@@ -172,7 +174,7 @@ void * jb_file_read(const char * path, size_t size)
   /* Open the file for reading.
    * Note that on Win32, by default, a file is opened in text mode, which means that "\r\n" is translated to
    * "\n" on input.  Open the file in binary mode, so that no such translation occurs.  (Linux, being (mostly)
-   * POSIX-compliant, does not suffer from this problem.  See also the comment on fopen in jb_file_write.)
+   * POSIX-compliant, does not suffer from this problem.  See also the comment on fopen in jb_file_create.)
    */
   if (!(f = fopen(path, "rb"))) { perror("fopen"); free(p); return NULL; }
 
@@ -194,22 +196,77 @@ int jb_file_write(const char * path, const void * buffer, size_t size)
   FILE * f;
   int n;
 
+  /* Open (and possibly create) the file for writing. */
+  if (!(f = jb_file_create(path))) return -1;
+
+  /* Write the buffer contents to the path. */
+  if (fwrite(buffer, 1, size, f) < size) { perror("fwrite"); n = errno; fclose(f); errno = n; return -1; }
+  if (fclose(f)) { perror("fclose"); return -1; }
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Create (or truncate) a file for writing, making sure that its parent directory exists.
+ *   path:  file pathname
+ * Return Value:  On success, the open file (which should be closed with fclose).
+ *   Otherwise, NULL (and errno is set appropriately).
+ */
+FILE * jb_file_create(const char * path)
+{
+  FILE * f;
+
   /* Before attempting to open (and possibly create) the file, make sure that its parent directory exists. */
-  if (make_directory(path)) return -1;
+  if (make_directory(path)) return NULL;
 
   /* Open the file for writing.
    * Note that on Win32, by default, a file is opened in text mode, which means that "\n" is translated to
    * "\r\n" on output.  Open the file in binary mode, so that no such translation occurs.  (Linux, being (mostly)
    * POSIX-compliant, does not suffer from this problem.  See also the comment on fopen in jb_file_read.)
    */
-  if (!(f = fopen(path, "wb"))) { perror("fopen"); return -1; }
+  if (!(f = fopen(path, "wb"))) perror("fopen");
+  return f;
+}
 
-  /* Write the buffer contents to the path. */
-  if (fwrite(buffer, 1, size, f) < size) { perror("fwrite"); n = errno; fclose(f); errno = n; return -1; }
-  if (fclose(f)) { perror("fclose"); return -1; }
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Write an unsigned integer to a file as a variable-length integer (seven bits per byte, least significant first,
+ * with the high bit of each byte set if another byte follows).
+ *   f:  file to write to
+ *   n:  integer to write
+ * Return Value:  Zero on success; otherwise, nonzero (and errno is set appropriately).
+ */
+int jb_file_put_varint(FILE * f, unsigned long long n)
+{
+  int c;
+
+  do
+  {
+    c = (int)(n & 0x7F);
+    if (n >>= 7) c |= 0x80;
+    if (putc(c, f) == EOF) return -1;
+  } while (n);
   return 0;
 }
 
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Read a variable-length integer (written by jb_file_put_varint) from a file.
+ *   f:  file to read from
+ *   n_ptr:  receives integer read
+ * Return Value:  Zero on success; otherwise (at end of file, on error, or if the integer is too long), nonzero.
+ */
+int jb_file_get_varint(FILE * f, unsigned long long * n_ptr)
+{
+  unsigned long long n = 0;
+  int i, c;
+
+  for (i = 0; i < 64; i += 7)
+  {
+    if ((c = getc(f)) == EOF) return -1;
+    n |= (unsigned long long)(c & 0x7F) << i;
+    if (!(c & 0x80)) { *n_ptr = n; return 0; }
+  }
+  return -1;
+}
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
  * Remove leading and trailing white-space characters from a string.
  *   s:  string to remove white-space characters from
@@ -355,6 +412,8 @@ int make_directory(const char * path)
   r = mkdir(p, mode);
 #endif
   free(s);
-  if (r) { perror("mkdir"); return r; }
+
+  /* (If another thread or process beat us to it, that's fine too.) */
+  if (r && errno != EEXIST) { perror("mkdir"); return r; }
   return 0;
 }
@@ -15,6 +15,13 @@
 #define _JB_H_
 
 
+/*****************
+ * Include Files *
+ *****************/
+
+#include <stdio.h>  /* FILE, size_t */
+
+
 /**************************
  * Structure Declarations *
  **************************/
@@ -48,6 +55,9 @@ int jb_command_parse(int argc, char * argv[], const char * usage, const char * h
 void jb_command_error(char * path, const char * usage);
 void * jb_file_read(const char * path, size_t size);
 int jb_file_write(const char * path, const void * buffer, size_t size);
+FILE * jb_file_create(const char * path);
+int jb_file_put_varint(FILE * f, unsigned long long n);
+int jb_file_get_varint(FILE * f, unsigned long long * n_ptr);
 char * jb_trim(char * s);
 
 
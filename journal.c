@@ -0,0 +1,242 @@
+/* journal.c - journal functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* A journal is an append-only text file recording the progress of a sync (see --journal and --resume), so that if the
+ * sync is interrupted, the next run can pick up where it left off.  Each line is one of the following records (with
+ * fields separated by tabs, and the relative pathname last, so that it may contain anything but a line break):
+ *   C  pathname                                 the file was completely synced
+ *   P  offset  size  mtime  dsts  pathname      the first offset bytes of the file (whose size and modification time were
+ *                                               as given) were copied to each destination in dsts (a hexadecimal bitmask)
+ * Progress is recorded only after the destination files have been flushed to disk, so the offset can be trusted.  (The
+ * same is not true of completion records, which are written as soon as each file is closed; thus, the journal protects
+ * against the interruption of Plunge, but not necessarily against the crash of the whole system.)  A record that was not
+ * completely written (i.e., the last line, if it does not end with a line break) is ignored.  When the journal is loaded,
+ * only the last record of each file matters.
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#ifdef _WIN32
+/* This eliminates deprecation warnings for functions that are considered "unsafe" (and would
+ * result in error C4996) on Win32, thus allowing us to write simpler, more portable code.
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <errno.h>    /* ENOENT, errno */
+#include <stdio.h>    /* fclose, fflush, fgets, FILE, fopen, fprintf, perror, sscanf */
+#include <stdlib.h>   /* bsearch, free, malloc, qsort, realloc */
+#include <string.h>   /* memcpy, strcmp, strlen */
+#include <time.h>     /* time_t */
+#include "jb.h"       /* JB_PATH_MAX_LENGTH */
+#include "journal.h"  /* (struct) journal, (struct) journal_entry */
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+int journal_load(struct journal * journal, FILE * f);
+int compare_entries(const void * a, const void * b);
+int find_entry(const void * key, const void * entry);
+
+
+/*********************
+ * Private Variables *
+ *********************/
+
+/* Entries being sorted (see compare_entries) */
+static struct journal_entry * sort_entries;
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Open a journal file.
+ *   path:  pathname of journal file
+ *   resume:  nonzero if the records already in the journal file should be loaded (and new ones appended to them)
+ *   record:  nonzero if new records are to be written (otherwise, the journal file is only read)
+ * Return Value:  On success, the journal (which should be closed with journal_close).  Otherwise, NULL.
+ */
+struct journal * journal_open(const char * path, int resume, int record)
+{
+  struct journal * journal;
+  FILE * f;
+
+  if (!(journal = (struct journal *)malloc(sizeof(struct journal)))) { perror("malloc"); return NULL; }
+  journal->file = NULL;
+  journal->entries = NULL;
+  journal->entry_count = 0;
+
+  /* If resuming, load the existing records.  (If there is no journal file yet, there is nothing to resume.) */
+  if (resume)
+  {
+    if (f = fopen(path, "rb"))
+    {
+      if (journal_load(journal, f)) { fclose(f); journal_close(journal); return NULL; }
+      fclose(f);
+    }
+    else if (errno != ENOENT) { perror("fopen"); free(journal); return NULL; }
+  }
+
+  /* Open the journal file for writing (appending to the existing records if resuming, or replacing them otherwise). */
+  if (record && !(journal->file = fopen(path, resume ? "ab" : "wb"))) { perror("fopen"); journal_close(journal); return NULL; }
+  return journal;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Find the last record of a file in a journal.
+ *   journal:  journal (opened by journal_open)
+ *   path:  relative pathname of file
+ * Return Value:  Last record of the file (or NULL, if there is none).
+ */
+const struct journal_entry * journal_find(struct journal * journal, const char * path)
+{
+  if (!journal->entry_count) return NULL;
+  return (struct journal_entry *)bsearch(path, journal->entries, journal->entry_count, sizeof(struct journal_entry), find_entry);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Record that a file was completely synced.  (Each record is written (and flushed) with a single call,
+ * so that records written by different threads (or processes sharing the journal file) do not overlap.)
+ *   journal:  journal (opened by journal_open)
+ *   path:  relative pathname of file
+ */
+void journal_complete(struct journal * journal, const char * path)
+{
+  if (!journal->file) return;
+  if (fprintf(journal->file, "C\t%s\n", path) < 0 || fflush(journal->file)) perror("fprintf");
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Record the progress of copying a (large) file.  The destination files must already have been flushed to disk.
+ *   journal:  journal (opened by journal_open)
+ *   path:  relative pathname of file
+ *   offset:  number of bytes of the file copied so far
+ *   size:  size (in bytes) of source file
+ *   mtime:  modification time of source file
+ *   dsts:  destinations being copied to (bit i for DEST i + 1)
+ */
+void journal_progress(struct journal * journal, const char * path, size_t offset, size_t size, time_t mtime,
+                      unsigned int dsts)
+{
+  if (!journal->file) return;
+  if (fprintf(journal->file, "P\t%llu\t%llu\t%lld\t%x\t%s\n", (unsigned long long)offset, (unsigned long long)size,
+              (long long)mtime, dsts, path) < 0 || fflush(journal->file)) perror("fprintf");
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Close a journal (and free the memory allocated for it).
+ *   journal:  journal (opened by journal_open)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int journal_close(struct journal * journal)
+{
+  int i, r = 0;
+
+  if (journal->file && (r = fclose(journal->file))) perror("fclose");
+  for (i = 0; i < journal->entry_count; ++i) free(journal->entries[i].path);
+  free(journal->entries);
+  free(journal);
+  return r;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Load the records of a journal file, keeping only the last record of each file (sorted by pathname).
+ *   journal:  journal (into which the records are loaded)
+ *   f:  journal file (open for reading)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int journal_load(struct journal * journal, FILE * f)
+{
+  char s[JB_PATH_MAX_LENGTH + 80], * p;
+  struct journal_entry e, * a = NULL, * b;
+  unsigned long long offset, size;
+  long long mtime;
+  int i, j, k, n = 0, size_n = 0, * x;
+
+  while (fgets(s, sizeof(s), f))
+  {
+    /* Ignore a record that was not completely written (or that is not a record at all). */
+    if (!(k = strlen(s)) || s[k - 1] != '\n') continue;
+    s[--k] = '\0';
+    if (s[0] == 'C' && s[1] == '\t') { e.complete = 1; e.offset = e.size = 0; e.mtime = 0; e.dsts = 0; p = s + 2; }
+    else if (s[0] == 'P' && sscanf(s, "P\t%llu\t%llu\t%lld\t%x\t%n", &offset, &size, &mtime, &e.dsts, &i) == 4)
+    {
+      e.complete = 0; e.offset = (size_t)offset; e.size = (size_t)size; e.mtime = (time_t)mtime; p = s + i;
+    }
+    else continue;
+
+    /* Add the record to the end of the array. */
+    if (n == size_n && !(a = (struct journal_entry *)realloc(a, (size_n = size_n ? size_n * 2 : 256) * sizeof(e))))
+    {
+      perror("realloc"); return -1;
+    }
+    if (!(e.path = (char *)malloc(k = strlen(p) + 1))) { perror("malloc"); return -1; }
+    memcpy(e.path, p, k);
+    a[n++] = e;
+    journal->entries = a;
+    journal->entry_count = n;
+  }
+  if (!n) return 0;
+
+  /* Sort (the indices of) the records by pathname (and, for each file, in the order they were written),
+   * then keep only the last record of each file (freeing the pathnames of the others).
+   */
+  if (!(x = (int *)malloc(n * sizeof(int))) || !(b = (struct journal_entry *)malloc(n * sizeof(e))))
+  {
+    perror("malloc"); free(x); return -1;
+  }
+  for (i = 0; i < n; ++i) x[i] = i;
+  sort_entries = a;
+  qsort(x, n, sizeof(int), compare_entries);
+  for (i = j = 0; i < n; ++i)
+  {
+    if (i + 1 < n && !strcmp(a[x[i]].path, a[x[i + 1]].path)) { free(a[x[i]].path); continue; }
+    b[j++] = a[x[i]];
+  }
+  free(x);
+  free(a);
+  journal->entries = b;
+  journal->entry_count = j;
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare two journal entries, by index into sort_entries (as a qsort comparison function).
+ * (Entries of the same file are compared by index, i.e., by the order in which they were written.)
+ *   a:  index of first entry
+ *   b:  index of second entry
+ * Return Value:  Negative, zero, or positive, depending on whether a sorts before, the same as, or after b.
+ */
+int compare_entries(const void * a, const void * b)
+{
+  int i = *(const int *)a, j = *(const int *)b, r = strcmp(sort_entries[i].path, sort_entries[j].path);
+
+  return r ? r : i - j;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare a pathname to a journal entry (as a bsearch comparison function).
+ *   key:  relative pathname
+ *   entry:  journal entry
+ * Return Value:  Negative, zero, or positive, depending on whether the pathname sorts before, the same as, or after the entry.
+ */
+int find_entry(const void * key, const void * entry)
+{
+  return strcmp((const char *)key, ((const struct journal_entry *)entry)->path);
+}
@@ -0,0 +1,62 @@
+/* journal.h - journal functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include <stddef.h>  /* size_t */
+#include <stdio.h>   /* FILE */
+#include <time.h>    /* time_t */
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Last record of a file in a journal (as loaded by journal_open) */
+struct journal_entry
+{
+  char * path;         /* relative pathname of file */
+  int complete;        /* nonzero if the file was completely synced (in which case the members below are unused) */
+  size_t offset;       /* number of bytes of the file known to have been copied (to each destination in dsts) */
+  size_t size;         /* size (in bytes) of source file at the time */
+  time_t mtime;        /* modification time of source file at the time */
+  unsigned int dsts;   /* destinations being copied to (bit i for DEST i + 1) */
+};
+
+struct journal
+{
+  FILE * file;                     /* journal file (open for appending), or NULL if nothing is to be recorded */
+  struct journal_entry * entries;  /* last record of each file (sorted by pathname) */
+  int entry_count;                 /* number of entries */
+};
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+struct journal * journal_open(const char * path, int resume, int record);
+const struct journal_entry * journal_find(struct journal * journal, const char * path);
+void journal_complete(struct journal * journal, const char * path);
+void journal_progress(struct journal * journal, const char * path, size_t offset, size_t size, time_t mtime,
+                      unsigned int dsts);
+int journal_close(struct journal * journal);
+
+
+#endif  /* (prevent multiple inclusion) */
@@ -0,0 +1,200 @@
+/* limit.c - resource limit functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* A limit is a token bucket, kept as the time at which everything consumed so far will have been paid for (at the limited
+ * rate).  Consuming something is allowed as soon as that time has come, no matter how much is consumed (which pushes the
+ * time further into the future, so that whoever consumes something next waits for it to be paid for).  Thus, the bucket may
+ * go into debt, but never stays there; and a small file never waits behind its own cost, only behind what came before it.
+ * Likewise, the time is never allowed to fall more than LIMIT_BURST behind the present, so unused capacity can be saved up
+ * only so far.  Since the whole state of the bucket is one integer, it is updated (by any thread) without a lock.
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#ifdef _WIN32
+#  include <windows.h>       /* GetCurrentProcess, InterlockedCompareExchange64, QueryPerformance*, SetPriorityClass, Sleep */
+#else
+#  include <sys/syscall.h>   /* SYS_ioprio_set */
+#  include <time.h>          /* clock_gettime, CLOCK_MONOTONIC, nanosleep, (struct) timespec */
+#  include <unistd.h>        /* nice, syscall */
+#endif
+#include <errno.h>           /* ENOSYS, errno */
+#include <stdio.h>           /* perror */
+#include "limit.h"           /* (struct) limit, LIMIT_BURST */
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Portable atomic compare-and-swap and addition (of 64-bit integers) */
+#ifdef _WIN32
+#  define ATOMIC_SWAP(p, old, new)  (InterlockedCompareExchange64((p), (new), (old)) == (old))
+#  define ATOMIC_ADD(p, n)          InterlockedExchangeAdd64((p), (n))
+#else
+#  define ATOMIC_SWAP(p, old, new)  __sync_bool_compare_and_swap((p), (old), (new))
+#  define ATOMIC_ADD(p, n)          __sync_fetch_and_add((p), (n))
+#endif
+
+/* I/O priority class (and how to set it) for the Linux ioprio_set system call (which glibc does not wrap) */
+#define IOPRIO_WHO_PROCESS    1
+#define IOPRIO_CLASS_IDLE     3
+#define IOPRIO_CLASS_SHIFT    13
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+void limit_sleep(long long t);
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Initialize a limit.
+ *   limit:  limit
+ *   rate:  number of units per second that may be consumed (or, if zero, there is no limit)
+ */
+void limit_init(struct limit * limit, double rate)
+{
+  limit->next = 0;
+  limit->total = 0;
+  limit_set(limit, rate);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Change the rate of a limit.  (This may be done at any time, by any thread.)
+ *   limit:  limit
+ *   rate:  number of units per second that may be consumed (or, if zero, there is no limit)
+ */
+void limit_set(struct limit * limit, double rate)
+{
+  limit->cost = (rate > 0) ? 1e9 / rate : 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Get the rate of a limit.
+ *   limit:  limit
+ * Return Value:  Number of units per second that may be consumed (or, if zero, there is no limit).
+ */
+double limit_rate(struct limit * limit)
+{
+  double cost = limit->cost;
+
+  return cost ? 1e9 / cost : 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Consume something subject to a limit, first waiting (if necessary) for whatever was consumed before to be paid for.
+ *   limit:  limit
+ *   amount:  number of units to consume
+ */
+void limit_take(struct limit * limit, double amount)
+{
+  long long now, next, t;
+  double cost;
+
+  ATOMIC_ADD(&limit->total, (long long)amount);
+  if (!(cost = limit->cost)) return;
+  for (;;)
+  {
+    /* If there is a debt, wait for it to be paid.  (Saved-up capacity goes back no further than LIMIT_BURST.) */
+    now = limit_clock();
+    if ((t = next = limit->next) > now) { limit_sleep(t - now); continue; }
+    if (t < now - LIMIT_BURST) t = now - LIMIT_BURST;
+
+    /* Consume the amount (unless another thread has consumed something in the meantime, in which case, try again). */
+    if (ATOMIC_SWAP(&limit->next, next, t + (long long)(amount * cost))) return;
+  }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Lower the I/O priority of this process (and of any threads it creates afterward), so that its disk I/O is done only when no
+ * other process needs the disk.  (On Linux, this is the idle I/O scheduling class; on Windows, background processing mode.)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int limit_idle(void)
+{
+#ifdef _WIN32
+  if (SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN)) return 0;
+  errno = ENOSYS;
+#elif defined SYS_ioprio_set
+  if (!syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT)) return 0;
+#else
+  errno = ENOSYS;
+#endif
+  perror("ioprio_set");
+  return -1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Lower the CPU priority of this process.  (On Windows, which has only a few priority classes, an increment of 10 or more
+ * means idle priority; anything less, below normal.)
+ *   increment:  amount by which to increase the niceness of the process (as with the nice command)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int limit_nice(int increment)
+{
+#ifdef _WIN32
+  if (SetPriorityClass(GetCurrentProcess(), (increment < 10) ? BELOW_NORMAL_PRIORITY_CLASS : IDLE_PRIORITY_CLASS)) return 0;
+  errno = ENOSYS;
+#else
+  /* (Since nice can legitimately return -1, errno must be cleared first to tell whether it failed.) */
+  errno = 0;
+  if (nice(increment) != -1 || !errno) return 0;
+#endif
+  perror("nice");
+  return -1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Get the current time (from a monotonic clock).
+ * Return Value:  Time (in nanoseconds) since some arbitrary point in the past.
+ */
+long long limit_clock(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER t, f;
+
+  QueryPerformanceCounter(&t);
+  QueryPerformanceFrequency(&f);
+  return (long long)((double)t.QuadPart * 1e9 / (double)f.QuadPart);
+#else
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (long long)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Sleep (i.e., suspend the calling thread) for a while.
+ *   t:  time (in nanoseconds) for which to sleep
+ */
+void limit_sleep(long long t)
+{
+#ifdef _WIN32
+  Sleep((DWORD)((t + 999999) / 1000000));
+#else
+  struct timespec s;
+
+  s.tv_sec = (time_t)(t / 1000000000);
+  s.tv_nsec = (long)(t % 1000000000);
+  nanosleep(&s, NULL);
+#endif
+}
@@ -0,0 +1,52 @@
+/* limit.h - resource limit functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _LIMIT_H_
+#define _LIMIT_H_
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Time (in nanoseconds) for which unused capacity may be saved up, and then spent all at once */
+#define LIMIT_BURST 1000000000LL  /* 1 second */
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Limit on the rate at which something (bytes, operations, etc.) may be consumed (by any number of threads) */
+struct limit
+{
+  volatile long long next;  /* time (in nanoseconds) at which everything consumed so far will have been paid for */
+  volatile double cost;     /* time (in nanoseconds) that it takes to pay for each unit consumed (or zero, if no limit) */
+  volatile long long total; /* number of units consumed so far (whether or not there is a limit) */
+};
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+void limit_init(struct limit * limit, double rate);
+void limit_set(struct limit * limit, double rate);
+double limit_rate(struct limit * limit);
+void limit_take(struct limit * limit, double amount);
+long long limit_clock(void);
+int limit_idle(void);
+int limit_nice(int increment);
+
+
+#endif  /* (prevent multiple inclusion) */
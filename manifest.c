@@ -0,0 +1,245 @@
+/* manifest.c - manifest functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* A manifest is a text file listing the SHA-256 of each file synced (see --manifest), in the format of sha256sum (so that
+ * the files can be checked with "sha256sum -c" from within DEST).  Each line is the hash (in hexadecimal), two spaces, and
+ * the relative pathname of the file; the lines are sorted by pathname.  When a manifest is written, the one it replaces
+ * (if any) is loaded first, so that the hashes of files that have not changed since can be reused rather than recomputed.
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#ifdef _WIN32
+/* This eliminates deprecation warnings for functions that are considered "unsafe" (and would
+ * result in error C4996) on Win32, thus allowing us to write simpler, more portable code.
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <errno.h>     /* ENOENT, errno */
+#include <stdio.h>     /* fclose, fgets, FILE, fopen, fprintf, perror */
+#include <stdlib.h>    /* bsearch, calloc, free, malloc, qsort, realloc */
+#include <string.h>    /* memcpy, strcmp, strlen */
+#include "jb.h"        /* JB_PATH_MAX_LENGTH */
+#include "sha256.h"    /* SHA256_SIZE */
+#include "manifest.h"  /* (struct) manifest, (struct) manifest_entry */
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+int manifest_load(struct manifest * manifest, FILE * f);
+int manifest_add(struct manifest_entry ** entries_ptr, int * count_ptr, int * size_ptr, const char * path,
+                 const unsigned char * hash);
+void manifest_free(struct manifest_entry * entries, int count);
+int compare_manifest_entries(const void * a, const void * b);
+int find_manifest_entry(const void * key, const void * entry);
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Open a manifest file (loading the hashes already in it).
+ *   path:  pathname of manifest file
+ *   write:  nonzero if the manifest file is to be replaced (by manifest_close), in which case it need not exist yet
+ * Return Value:  On success, the manifest (which should be closed with manifest_close).  Otherwise, NULL.
+ */
+struct manifest * manifest_open(const char * path, int write)
+{
+  struct manifest * manifest;
+  size_t n = strlen(path) + 1;
+  FILE * f;
+  int r;
+
+  if (!(manifest = (struct manifest *)calloc(1, sizeof(struct manifest)))) { perror("calloc"); return NULL; }
+  if (write && !(manifest->path = (char *)malloc(n))) { perror("malloc"); free(manifest); return NULL; }
+  if (write) memcpy(manifest->path, path, n);
+
+  /* Load the existing hashes.  (If there is no manifest file yet, there are none, which is fine if one is to be written.) */
+  if (f = fopen(path, "rb"))
+  {
+    r = manifest_load(manifest, f);
+    fclose(f);
+    if (r) { free(manifest->path); manifest->path = NULL; manifest_close(manifest); return NULL; }
+  }
+  else if (errno != ENOENT || !write) { perror(path); free(manifest->path); free(manifest); return NULL; }
+  return manifest;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Find the hash of a file in a manifest (as loaded).
+ *   manifest:  manifest (opened by manifest_open)
+ *   path:  relative pathname of file
+ * Return Value:  Hash of file (SHA256_SIZE bytes), or NULL if the file is not in the manifest.
+ */
+const unsigned char * manifest_find(struct manifest * manifest, const char * path)
+{
+  struct manifest_entry * e;
+
+  if (!manifest->entry_count) return NULL;
+  e = (struct manifest_entry *)bsearch(path, manifest->entries, manifest->entry_count, sizeof(struct manifest_entry),
+                                       find_manifest_entry);
+  return e ? e->hash : NULL;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Add the hash of a file to a manifest (to be written when it is closed).  (This must not be called by more than one thread
+ * at a time.)
+ *   manifest:  manifest (opened by manifest_open)
+ *   path:  relative pathname of file
+ *   hash:  hash of file (SHA256_SIZE bytes)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int manifest_put(struct manifest * manifest, const char * path, const unsigned char * hash)
+{
+  return manifest_add(&manifest->puts, &manifest->put_count, &manifest->put_size, path, hash);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Close a manifest (writing the hashes added to it, sorted by pathname, if it is to be written), and free the memory
+ * allocated for it.
+ *   manifest:  manifest (opened by manifest_open)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int manifest_close(struct manifest * manifest)
+{
+  FILE * f = NULL;
+  int i, j, r = 0;
+
+  if (manifest->path)
+  {
+    qsort(manifest->puts, manifest->put_count, sizeof(struct manifest_entry), compare_manifest_entries);
+    if (!(f = fopen(manifest->path, "wb"))) { perror("fopen"); r = -1; }
+    for (i = 0; f && i < manifest->put_count; ++i)
+    {
+      for (j = 0; j < SHA256_SIZE; ++j) fprintf(f, "%02x", manifest->puts[i].hash[j]);
+      if (fprintf(f, "  %s\n", manifest->puts[i].path) < 0) { perror("fprintf"); r = -1; break; }
+    }
+    if (f && fclose(f)) { perror("fclose"); r = -1; }
+  }
+  manifest_free(manifest->entries, manifest->entry_count);
+  manifest_free(manifest->puts, manifest->put_count);
+  free(manifest->path);
+  free(manifest);
+  return r;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Load the hashes of a manifest file (sorted by pathname).  (Lines that are not in the format of sha256sum are ignored.)
+ *   manifest:  manifest (into which the hashes are loaded)
+ *   f:  manifest file (open for reading)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int manifest_load(struct manifest * manifest, FILE * f)
+{
+  static const int k = 2 * SHA256_SIZE;
+
+  char s[JB_PATH_MAX_LENGTH + 80];
+  unsigned char h[SHA256_SIZE];
+  int i, n, x, size_n = 0;
+
+  while (fgets(s, sizeof(s), f))
+  {
+    /* Strip the line break (ignoring a line that was not completely written). */
+    if (!(n = strlen(s)) || s[n - 1] != '\n') continue;
+    s[--n] = '\0';
+    if (n && s[n - 1] == '\r') s[--n] = '\0';
+
+    /* The line must begin with the hash (in hexadecimal), followed by a space and either a space or an asterisk. */
+    if (n < k + 3 || s[k] != ' ' || (s[k + 1] != ' ' && s[k + 1] != '*')) continue;
+    for (i = 0; i < k; ++i)
+    {
+      if (s[i] >= '0' && s[i] <= '9') x = s[i] - '0';
+      else if (s[i] >= 'a' && s[i] <= 'f') x = s[i] - 'a' + 10;
+      else if (s[i] >= 'A' && s[i] <= 'F') x = s[i] - 'A' + 10;
+      else break;
+      h[i / 2] = (i & 1) ? (h[i / 2] | x) : (unsigned char)(x << 4);
+    }
+    if (i < k) continue;
+    if (manifest_add(&manifest->entries, &manifest->entry_count, &size_n, s + k + 2, h)) return -1;
+  }
+  qsort(manifest->entries, manifest->entry_count, sizeof(struct manifest_entry), compare_manifest_entries);
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Add the hash of a file to the end of an array (allocating memory for more items, if necessary).
+ *   entries_ptr:  array (which may be reallocated)
+ *   count_ptr:  number of items in array
+ *   size_ptr:  number of items for which memory is allocated
+ *   path:  relative pathname of file
+ *   hash:  hash of file (SHA256_SIZE bytes)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int manifest_add(struct manifest_entry ** entries_ptr, int * count_ptr, int * size_ptr, const char * path,
+                 const unsigned char * hash)
+{
+  struct manifest_entry * e;
+  size_t n = strlen(path) + 1;
+
+  if (*count_ptr == *size_ptr)
+  {
+    if (!(e = (struct manifest_entry *)realloc(*entries_ptr, (*size_ptr ? *size_ptr * 2 : 256) * sizeof(*e))))
+    {
+      perror("realloc"); return -1;
+    }
+    *entries_ptr = e;
+    *size_ptr = *size_ptr ? *size_ptr * 2 : 256;
+  }
+  e = &(*entries_ptr)[*count_ptr];
+  if (!(e->path = (char *)malloc(n))) { perror("malloc"); return -1; }
+  memcpy(e->path, path, n);
+  memcpy(e->hash, hash, SHA256_SIZE);
+  ++*count_ptr;
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Free an array of hashes (and their pathnames).
+ *   entries:  array
+ *   count:  number of items in array
+ */
+void manifest_free(struct manifest_entry * entries, int count)
+{
+  int i;
+
+  for (i = 0; i < count; ++i) free(entries[i].path);
+  free(entries);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare two manifest entries by pathname (as a qsort comparison function).
+ *   a:  first entry
+ *   b:  second entry
+ * Return Value:  Negative, zero, or positive, depending on whether a sorts before, the same as, or after b.
+ */
+int compare_manifest_entries(const void * a, const void * b)
+{
+  return strcmp(((const struct manifest_entry *)a)->path, ((const struct manifest_entry *)b)->path);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare a pathname to a manifest entry (as a bsearch comparison function).
+ *   key:  relative pathname
+ *   entry:  manifest entry
+ * Return Value:  Negative, zero, or positive, depending on whether the pathname sorts before, the same as, or after the entry.
+ */
+int find_manifest_entry(const void * key, const void * entry)
+{
+  return strcmp((const char *)key, ((const struct manifest_entry *)entry)->path);
+}
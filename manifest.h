@@ -0,0 +1,57 @@
+/* manifest.h - manifest functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _MANIFEST_H_
+#define _MANIFEST_H_
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include "sha256.h"  /* SHA256_SIZE */
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Hash of a file in a manifest */
+struct manifest_entry
+{
+  char * path;                         /* relative pathname of file */
+  unsigned char hash[SHA256_SIZE];     /* SHA-256 of file */
+};
+
+struct manifest
+{
+  char * path;                         /* pathname of manifest file to write (or NULL, if it is only read) */
+  struct manifest_entry * entries;     /* hash of each file in the manifest file, as loaded (sorted by pathname) */
+  int entry_count;                     /* number of entries */
+  struct manifest_entry * puts;        /* hash of each file to be written to the manifest file (see manifest_put) */
+  int put_count;                       /* number of items in puts */
+  int put_size;                        /* number of items for which memory is allocated */
+};
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+struct manifest * manifest_open(const char * path, int write);
+const unsigned char * manifest_find(struct manifest * manifest, const char * path);
+int manifest_put(struct manifest * manifest, const char * path, const unsigned char * hash);
+int manifest_close(struct manifest * manifest);
+
+
+#endif  /* (prevent multiple inclusion) */
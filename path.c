@@ -77,3 +77,23 @@ void path_output(const char * path, int width)
   /* Finally, null-terminate and output the string buffer. */
   s[n] = '\0'; printf("%s", s);
 }
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Determine the shard to which a relative pathname belongs, by hashing it (with 64-bit FNV-1a).  The hash does not depend
+ * on the platform (any directory separator is hashed as '/'), so that runs on different hosts agree on which files are whose.
+ *   path:  relative pathname
+ *   count:  number of shards
+ * Return Value:  Index of shard (from 0 to count - 1).
+ */
+int path_shard(const char * path, int count)
+{
+  unsigned long long h = 0xCBF29CE484222325ULL;
+
+  if (count < 2) return 0;
+  for (; *path; ++path)
+  {
+    h ^= (unsigned char)((*path == JB_PATH_SEPARATOR) ? '/' : *path);
+    h *= 0x100000001B3ULL;
+  }
+  return (int)(h % (unsigned int)count);
+}
@@ -28,6 +28,7 @@
 
 void path_build(char * abs, const char * dir, const char * rel);
 void path_output(const char * path, int width);
+int path_shard(const char * path, int count);
 
 
 #endif  /* (prevent multiple inclusion) */
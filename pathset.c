@@ -0,0 +1,205 @@
+/* pathset.c - path set functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* A path set holds the relative pathnames of a job (e.g., those a purge must skip) in much less memory than one string per
+ * pathname would take: they are sorted, and each is stored as the length of the prefix it shares with the one before it
+ * (which, for files in the same directory, is most of it) and the rest of it.  To find a pathname without decoding the
+ * whole set, the pathnames are divided into blocks of PATHSET_BLOCK_SIZE, the first of which is stored in full; so a search
+ * of the first pathname of each block finds the only block the pathname could be in, and then that block (which is small,
+ * and contiguous in memory) is decoded in order.  Since the sorted pathnames are in the order a trie of their components
+ * would be walked, pathnames are looked up in order as well, with a cursor that only moves forward (see pathset_seek):
+ * then walking a directory tree alongside the set finds each file close to the last one.  (Since a pathname is shorter
+ * than JB_PATH_MAX_LENGTH, each length fits in one byte.)
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include <stddef.h>    /* size_t */
+#include <stdio.h>     /* perror */
+#include <stdlib.h>    /* free, malloc, qsort, realloc */
+#include <string.h>    /* memcpy, strcmp, strlen, strncmp */
+#include "jb.h"        /* JB_PATH_MAX_LENGTH */
+#include "pathset.h"   /* (struct) pathset, (struct) pathset_cursor, PATHSET_BLOCK_SIZE */
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+void pathset_decode(struct pathset_cursor * cursor, int index);
+int pathset_compare(const struct pathset * set, int block, const char * path);
+int compare_strings(const void * a, const void * b);
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Create a path set.
+ *   paths:  relative pathnames (in any order, and not necessarily distinct), which are copied into the set
+ *   count:  number of pathnames in paths
+ * Return Value:  On success, the set (which should be freed with pathset_free).  Otherwise, NULL.
+ */
+struct pathset * pathset_create(char ** paths, int count)
+{
+  struct pathset * set;
+  char ** a = NULL;
+  unsigned char * p;
+  size_t k, n, size = 0;
+  int i, j;
+
+  if (!(set = (struct pathset *)malloc(sizeof(struct pathset)))) { perror("malloc"); return NULL; }
+
+  /* Sort (a copy of) the array, to find out how much memory the pathnames could take at most. */
+  if (count && !(a = (char **)malloc(count * sizeof(char *)))) { perror("malloc"); free(set); return NULL; }
+  if (count) memcpy(a, paths, count * sizeof(char *));
+  qsort(a, count, sizeof(char *), compare_strings);
+  for (i = 0; i < count; ++i) size += strlen(a[i]) + 2;
+
+  set->data = (unsigned char *)malloc(size + 1);
+  set->blocks = (size_t *)malloc((count / PATHSET_BLOCK_SIZE + 1) * sizeof(size_t));
+  if (!set->data || !set->blocks) { perror("malloc"); free(a); pathset_free(set); return NULL; }
+
+  /* Encode each (distinct) pathname, starting a new block every so often. */
+  for (p = set->data, i = j = 0; i < count; ++i)
+  {
+    if (j && !strcmp(a[i], a[i - 1])) continue;
+    k = 0; n = strlen(a[i]);
+    if (j % PATHSET_BLOCK_SIZE) for (; a[i][k] && a[i][k] == a[i - 1][k]; ++k);
+    else set->blocks[j / PATHSET_BLOCK_SIZE] = p - set->data;
+    *p++ = (unsigned char)k;
+    *p++ = (unsigned char)(n - k);
+    memcpy(p, a[i] + k, n - k);
+    p += n - k; ++j;
+  }
+  set->count = j;
+  free(a);
+
+  /* Give back the memory saved by front coding. */
+  if (p = (unsigned char *)realloc(set->data, p - set->data + 1)) set->data = p;
+  return set;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Position a cursor at the first pathname of a path set.
+ *   cursor:  cursor
+ *   set:  path set (created by pathset_create)
+ */
+void pathset_start(struct pathset_cursor * cursor, const struct pathset * set)
+{
+  cursor->set = set;
+  cursor->path[0] = '\0';
+  pathset_decode(cursor, 0);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Determine whether or not a pathname is in a path set, moving a cursor forward to the first pathname in the set that does
+ * not sort before it.  So pathnames must be looked up in sorted order (from the time the cursor is started), which makes
+ * the set work like a trie: since the pathnames of the files in a directory are together, looking up the files of a
+ * directory tree in order moves the cursor only as far as the next one each time (within the block it is in, or else
+ * galloping to the block the next one is in).  (A cursor can be copied, to look up another subtree from the same place.)
+ *   cursor:  cursor (started by pathset_start)
+ *   path:  relative pathname (not sorting before any looked up with the cursor before)
+ *   prefix:  nonzero if any pathname that begins with path counts; otherwise, zero (if only path itself counts)
+ * Return Value:  Nonzero if the pathname is in the set; otherwise, zero.
+ */
+int pathset_seek(struct pathset_cursor * cursor, const char * path, int prefix)
+{
+  const struct pathset * set = cursor->set;
+  int i, j, k, n = (set->count + PATHSET_BLOCK_SIZE - 1) / PATHSET_BLOCK_SIZE;
+
+  if (cursor->index < set->count && strcmp(cursor->path, path) < 0)
+  {
+    /* If the pathname is not in the current block (i.e., the first pathname of the next block does not sort after it),
+     * find the block it is in: gallop ahead (doubling the distance each time) to a block whose first pathname does sort
+     * after it, and then binary search the blocks in between.
+     */
+    i = cursor->index / PATHSET_BLOCK_SIZE;
+    for (k = 1; i + k < n && pathset_compare(set, i + k, path) <= 0; k *= 2);
+    if (k > 1)
+    {
+      for (i += k / 2, n = (i + k / 2 < n) ? i + k / 2 : n; n - i > 1;)
+      {
+        if (pathset_compare(set, j = (i + n) / 2, path) <= 0) i = j; else n = j;
+      }
+      pathset_decode(cursor, i * PATHSET_BLOCK_SIZE);
+    }
+
+    /* Decode the pathnames in order, up to the first that does not sort before the given one. */
+    while (cursor->index < set->count && strcmp(cursor->path, path) < 0) pathset_decode(cursor, cursor->index + 1);
+  }
+
+  /* The pathname is in the set if it is the one at the cursor (or, if only the prefix counts, if that one begins with it,
+   * since any other pathname beginning with it would sort after that one).
+   */
+  if (cursor->index == set->count) return 0;
+  return prefix ? !strncmp(cursor->path, path, strlen(path)) : !strcmp(cursor->path, path);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Free the memory allocated for a path set.
+ *   set:  path set (created by pathset_create)
+ */
+void pathset_free(struct pathset * set)
+{
+  free(set->data);
+  free(set->blocks);
+  free(set);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Move a cursor to a pathname in a path set, and decode it.
+ *   cursor:  cursor
+ *   index:  index of pathname (which must be the first of a block, or the one after that at the cursor), or the number of
+ *     pathnames (to move the cursor to the end)
+ */
+void pathset_decode(struct pathset_cursor * cursor, int index)
+{
+  const unsigned char * p;
+
+  if ((cursor->index = index) == cursor->set->count) return;
+  if (!(index % PATHSET_BLOCK_SIZE)) cursor->offset = cursor->set->blocks[index / PATHSET_BLOCK_SIZE];
+  p = cursor->set->data + cursor->offset;
+  ((char *)memcpy(cursor->path + p[0], p + 2, p[1]))[p[1]] = '\0';
+  cursor->offset += 2 + p[1];
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare the first pathname of a block of a path set to a given pathname (without decoding it).
+ *   set:  path set
+ *   block:  index of block
+ *   path:  pathname
+ * Return Value:  Negative, zero, or positive, depending on whether the first pathname of the block sorts before, the same
+ *   as, or after the given one.
+ */
+int pathset_compare(const struct pathset * set, int block, const char * path)
+{
+  const unsigned char * p = set->data + set->blocks[block];
+  int r = strncmp((const char *)p + 2, path, p[1]);
+
+  return r ? r : path[p[1]] ? -1 : 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare two pathnames (as a qsort comparison function).
+ *   a:  first pathname
+ *   b:  second pathname
+ * Return Value:  Negative, zero, or positive, depending on whether a sorts before, the same as, or after b.
+ */
+int compare_strings(const void * a, const void * b)
+{
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
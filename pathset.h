@@ -0,0 +1,68 @@
+/* pathset.h - path set functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _PATHSET_H_
+#define _PATHSET_H_
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include <stddef.h>  /* size_t */
+#include "jb.h"      /* JB_PATH_MAX_LENGTH */
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Number of pathnames in each block of a set (the first of which is stored in full) */
+#define PATHSET_BLOCK_SIZE 16
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Sorted set of relative pathnames, front-coded in blocks */
+struct pathset
+{
+  unsigned char * data;   /* for each pathname, the length of the prefix it shares with the one before it (or zero, if
+                           * it is the first of a block), the length of the rest of it, and the rest of it
+                           */
+  size_t * blocks;        /* offset into data of the first pathname of each block */
+  int count;              /* number of pathnames */
+};
+
+/* Position in a path set (see pathset_seek) */
+struct pathset_cursor
+{
+  const struct pathset * set;     /* path set */
+  int index;                      /* index of the pathname at the position (or, at the end, the number of pathnames) */
+  size_t offset;                  /* offset into data of the pathname after it */
+  char path[JB_PATH_MAX_LENGTH];  /* pathname at the position */
+};
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+struct pathset * pathset_create(char ** paths, int count);
+void pathset_start(struct pathset_cursor * cursor, const struct pathset * set);
+int pathset_seek(struct pathset_cursor * cursor, const char * path, int prefix);
+void pathset_free(struct pathset * set);
+
+
+#endif  /* (prevent multiple inclusion) */
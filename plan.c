@@ -0,0 +1,189 @@
+/* plan.c - plan functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* A plan is a compact binary file recording the results of comparing files, so that they can be synced later (see
+ * --plan and --apply).  It begins with a signature and version, followed by the number of destinations and of files
+ * (as variable-length integers).  Then, for each file:
+ *   - the length of the prefix its relative pathname shares with the previous one, and the length of the rest of it
+ *     (as variable-length integers), followed by the rest of it (with '/' as the directory separator, on any platform)
+ *   - the result of comparing it to each destination file (one byte per destination)
+ *   - its size and modification time (as variable-length integers, the latter zigzag-encoded)
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#ifdef _WIN32
+/* This eliminates deprecation warnings for functions that are considered "unsafe" (and would
+ * result in error C4996) on Win32, thus allowing us to write simpler, more portable code.
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <stdio.h>   /* fclose, FILE, fopen, fprintf, fread, fseek, ftell, fwrite, perror, SEEK_END, SEEK_SET, stderr */
+#include <stdlib.h>  /* free, malloc */
+#include <string.h>  /* memcmp, memcpy, strlen */
+#include <time.h>    /* time_t */
+#include "jb.h"      /* jb_file_create, jb_file_get_varint, jb_file_put_varint, JB_PATH_MAX_LENGTH, JB_PATH_SEPARATOR */
+#include "plan.h"    /* (struct) plan */
+
+
+/*************
+ * Constants *
+ *************/
+
+static const char SIGNATURE[4] = { 'P', 'L', 'N', 'G' };
+static const int VERSION = 1;
+static const char * STR_INVALID_FORMAT = "%s: not a valid plan\n";
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Create a plan file.
+ *   path:  pathname of plan file
+ *   dst_count:  number of destination directories
+ *   file_count:  number of files to be put into the plan
+ * Return Value:  On success, the plan (which should be closed with plan_close).  Otherwise, NULL.
+ */
+struct plan * plan_create(const char * path, int dst_count, int file_count)
+{
+  struct plan * plan;
+
+  if (!(plan = (struct plan *)malloc(sizeof(struct plan)))) { perror("malloc"); return NULL; }
+  if (!(plan->file = jb_file_create(path))) { free(plan); return NULL; }
+  plan->path = path;
+  plan->dst_count = dst_count;
+  plan->last[0] = '\0';
+
+  /* Write the header. */
+  if (fwrite(SIGNATURE, 1, sizeof(SIGNATURE), plan->file) < sizeof(SIGNATURE) || putc(VERSION, plan->file) == EOF ||
+      jb_file_put_varint(plan->file, dst_count) || jb_file_put_varint(plan->file, file_count))
+  {
+    perror("fwrite"); fclose(plan->file); free(plan); return NULL;
+  }
+  return plan;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Open a plan file (for reading).
+ *   path:  pathname of plan file
+ *   dst_count_ptr:  receives number of destination directories
+ *   file_count_ptr:  receives number of files in the plan
+ * Return Value:  On success, the plan (which should be closed with plan_close).  Otherwise, NULL.
+ */
+struct plan * plan_open(const char * path, int * dst_count_ptr, int * file_count_ptr)
+{
+  struct plan * plan;
+  char s[sizeof(SIGNATURE)];
+  unsigned long long m, n;
+  long o, e;
+
+  if (!(plan = (struct plan *)malloc(sizeof(struct plan)))) { perror("malloc"); return NULL; }
+  if (!(plan->file = fopen(path, "rb"))) { perror("fopen"); free(plan); return NULL; }
+  plan->path = path;
+  plan->last[0] = '\0';
+
+  /* Read (and validate) the header.  (Each file takes at least four bytes, plus one for each destination, so a plan cannot
+   * hold more files than would fit in the rest of it.)
+   */
+  if (fread(s, 1, sizeof(s), plan->file) < sizeof(s) || memcmp(s, SIGNATURE, sizeof(s)) || getc(plan->file) != VERSION ||
+      jb_file_get_varint(plan->file, &m) || jb_file_get_varint(plan->file, &n) || !m || m > 0x7FFFFFFF || n > 0x7FFFFFFF ||
+      (o = ftell(plan->file)) < 0 || fseek(plan->file, 0, SEEK_END) || (e = ftell(plan->file)) < 0 ||
+      fseek(plan->file, o, SEEK_SET) || n > (unsigned long long)(e - o) / (m + 4))
+  {
+    fprintf(stderr, STR_INVALID_FORMAT, path); fclose(plan->file); free(plan); return NULL;
+  }
+  *dst_count_ptr = plan->dst_count = (int)m;
+  *file_count_ptr = (int)n;
+  return plan;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Put a file into a plan.
+ *   plan:  plan (created by plan_create)
+ *   path:  relative pathname of file
+ *   results:  result of comparing the source file to each destination file
+ *   size:  size (in bytes) of source file
+ *   mtime:  modification time of source file
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int plan_put(struct plan * plan, const char * path, const unsigned char * results, size_t size, time_t mtime)
+{
+  char s[JB_PATH_MAX_LENGTH];
+  size_t i, n = strlen(path);
+  long long t = mtime;
+
+  /* Use '/' as the directory separator (so that the plan can be applied on any platform). */
+  for (i = 0; i <= n; ++i) s[i] = (path[i] == JB_PATH_SEPARATOR) ? '/' : path[i];
+
+  /* Determine how much of the pathname is the same as the previous one, and write only the rest. */
+  for (i = 0; s[i] && s[i] == plan->last[i]; ++i);
+  if (jb_file_put_varint(plan->file, i) || jb_file_put_varint(plan->file, n - i) ||
+      fwrite(s + i, 1, n - i, plan->file) < n - i || fwrite(results, 1, plan->dst_count, plan->file) < (size_t)plan->dst_count ||
+      jb_file_put_varint(plan->file, size) || jb_file_put_varint(plan->file, ((unsigned long long)t << 1) ^ (t >> 63)))
+  {
+    perror("fwrite"); return -1;
+  }
+  memcpy(plan->last, s, n + 1);
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Get the next file from a plan.
+ *   plan:  plan (opened by plan_open)
+ *   path:  receives relative pathname of file
+ *   results:  receives result of comparing the source file to each destination file
+ *   size_ptr:  receives size (in bytes) of source file
+ *   mtime_ptr:  receives modification time of source file
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int plan_get(struct plan * plan, char * path, unsigned char * results, size_t * size_ptr, time_t * mtime_ptr)
+{
+  unsigned long long i, n, m, t;
+  char * p;
+
+  /* Read the pathname (the part that is not the same as the previous one), and (after validating it) the rest of the file. */
+  if (jb_file_get_varint(plan->file, &i) || jb_file_get_varint(plan->file, &n) ||
+      i > strlen(plan->last) || (n += i) >= JB_PATH_MAX_LENGTH || fread(plan->last + i, 1, n - i, plan->file) < n - i ||
+      fread(results, 1, plan->dst_count, plan->file) < (size_t)plan->dst_count ||
+      jb_file_get_varint(plan->file, &m) || jb_file_get_varint(plan->file, &t))
+  {
+    fprintf(stderr, STR_INVALID_FORMAT, plan->path); return -1;
+  }
+  plan->last[n] = '\0';
+  *size_ptr = (size_t)m;
+  *mtime_ptr = (time_t)((long long)(t >> 1) ^ -(long long)(t & 1));
+
+  /* Use the platform-dependent directory separator. */
+  memcpy(path, plan->last, n + 1);
+  for (p = path; *p; ++p) if (*p == '/') *p = JB_PATH_SEPARATOR;
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Close a plan file (and free the memory allocated for the plan).
+ *   plan:  plan (created by plan_create or opened by plan_open)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int plan_close(struct plan * plan)
+{
+  int r = fclose(plan->file);
+
+  if (r) perror("fclose");
+  free(plan);
+  return r;
+}
@@ -0,0 +1,52 @@
+/* plan.h - plan functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _PLAN_H_
+#define _PLAN_H_
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include <stddef.h>  /* size_t */
+#include <stdio.h>   /* FILE */
+#include <time.h>    /* time_t */
+#include "jb.h"      /* JB_PATH_MAX_LENGTH */
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+struct plan
+{
+  FILE * file;
+  const char * path;
+  int dst_count;
+  char last[JB_PATH_MAX_LENGTH];
+};
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+struct plan * plan_create(const char * path, int dst_count, int file_count);
+struct plan * plan_open(const char * path, int * dst_count_ptr, int * file_count_ptr);
+int plan_put(struct plan * plan, const char * path, const unsigned char * results, size_t size, time_t mtime);
+int plan_get(struct plan * plan, char * path, unsigned char * results, size_t * size_ptr, time_t * mtime_ptr);
+int plan_close(struct plan * plan);
+
+
+#endif  /* (prevent multiple inclusion) */
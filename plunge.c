@@ -14,23 +14,54 @@
  * Include Files *
  *****************/
 
-#include <sys/stat.h>     /* S_IFMT, S_IFREG, stat, (struct) stat */
 #ifdef _WIN32
+/* This eliminates deprecation warnings for functions that are considered "unsafe" (and would
+ * result in error C4996) on Win32, thus allowing us to write simpler, more portable code.
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <sys/stat.h>     /* fstatat, S_IFMT, S_IFREG, S_ISDIR, stat, (struct) stat, utimensat, UTIME_NOW */
+#ifdef _WIN32
+#  include <windows.h>    /* GetVolumeInformationA, GetVolumePathNameA, MAX_PATH */
 #  include <sys/utime.h>  /* (struct) utimbuf, utime */
 #  include <io.h>         /* _A_SUBDIR, _findclose, (struct) _finddata_t, _findfirst, _findnext, intptr_t */
+#  include <direct.h>     /* _rmdir */
 #else
-#  include <utime.h>      /* (struct) utimbuf, utime */
-#  include <dirent.h>     /* closedir, DIR, (struct) dirent, DT_DIR, opendir, readdir */
+#  include <sys/vfs.h>    /* (struct) statfs, statfs */
+#  include <sys/syscall.h>  /* SYS_getdents64 */
+#  include <dirent.h>     /* DT_DIR, DT_UNKNOWN */
+#  include <fcntl.h>      /* AT_FDCWD, AT_REMOVEDIR, AT_SYMLINK_NOFOLLOW, O_DIRECTORY, O_RDONLY, open, posix_fadvise,
+                             POSIX_FADV_DONTNEED, POSIX_FADV_SEQUENTIAL */
+#  include <unistd.h>     /* close, syscall, unlinkat */
 #endif
 #include <errno.h>        /* ENOENT, errno */
-#include <stdlib.h>       /* EXIT_FAILURE, EXIT_SUCCESS, free, malloc, realloc */
-#include <string.h>       /* memcpy, strcmp, strlen, strncmp */
+#include <stdlib.h>       /* calloc, EXIT_FAILURE, EXIT_SUCCESS, free, malloc, qsort, realloc, strtod, strtol */
+#include <string.h>       /* memcpy, memset, strcmp, strlen, strncmp */
 #include <time.h>         /* time */
 #include <limits.h>       /* INT_MIN */
-#include <stdio.h>        /* fgets, perror, puts, stdin */
-#include "jb.h"           /* (struct) jb_command_option, jb_command_parse, JB_PATH_SEPARATOR,
-                             jb_file_read, jb_file_write, JB_PATH_MAX_LENGTH, jb_trim */
-#include "path.h"         /* MAX_LINE_LENGTH, path_build, path_output */
+#include <stdio.h>        /* fclose, ferror, fgets, FILE, fopen, fprintf, fread, fwrite, perror, printf, puts, remove,
+                             sprintf, stderr, stdin */
+#include "crc.h"          /* crc_init, crc_update */
+#include "device.h"       /* device_claim, device_done, device_find, device_queue, device_start */
+#include "dircache.h"     /* (struct) dircache, dircache_close, dircache_find, dircache_open, dircache_put */
+#include "jb.h"           /* (struct) jb_command_option, jb_command_error, jb_command_parse, jb_file_create,
+                             JB_PATH_SEPARATOR, JB_PATH_MAX_LENGTH, jb_trim */
+#include "journal.h"      /* (struct) journal, journal_close, journal_complete, (struct) journal_entry, journal_find,
+                             journal_open, journal_progress */
+#include "limit.h"        /* (struct) limit, limit_idle, limit_init, limit_nice, limit_take */
+#include "manifest.h"     /* (struct) manifest, manifest_close, manifest_find, manifest_open, manifest_put */
+#include "path.h"         /* MAX_LINE_LENGTH, path_build, path_output, path_shard */
+#include "pathset.h"      /* (struct) pathset, pathset_create, (struct) pathset_cursor, pathset_free, pathset_seek,
+                             pathset_start */
+#include "plan.h"         /* plan_close, plan_create, plan_get, plan_open, plan_put */
+#include "pressure.h"     /* pressure_check, pressure_start */
+#include "sha256.h"       /* (struct) sha256, sha256_final, sha256_init, sha256_update, SHA256_SIZE */
+#include "share.h"        /* (struct) share, share_attach, share_claim, share_close, share_create, share_finish, share_path,
+                             (struct) share_stats, SHARE_BATCH_SIZE */
+#include "spill.h"        /* (struct) spill, spill_close, spill_create, spill_find, spill_get, spill_put, spill_rewind */
+#include "tune.h"         /* tune_check, tune_phase, tune_start, TUNE_BANDWIDTH, TUNE_MAX_JOBS, TUNE_METADATA */
+#include "work.h"         /* work_add, work_run, work_start, work_stop, work_tree, WORK_MAX_JOBS */
 
 
 /**************************
@@ -47,24 +78,281 @@ enum compare_files_result
   COMPARE_FILES_SAME_AGE,
   COMPARE_FILES_DST_NEWER,
   COMPARE_FILES_SRC_LARGER,
-  COMPARE_FILES_SRC_NEWER
+  COMPARE_FILES_SRC_NEWER,
+  COMPARE_FILES_DST_PARTIAL,
+  COMPARE_FILES_DIFFERENT,
+  COMPARE_FILES_SAME_SIZE,
+  COMPARE_FILES_SIZE_DIFFERS,
+  COMPARE_FILES_SAME_CONTENTS,
+  COMPARE_FILES_CONTENTS_DIFFER,
+  COMPARE_FILES_DST_REPLACE,
+  COMPARE_FILES_DST_EXISTS,
+  COMPARE_FILES_UNCHANGED
+};
+
+enum scrub_file_result
+{
+  SCRUB_FILE_SKIPPED,
+  SCRUB_FILE_ERROR,
+  SCRUB_FILE_NO_EXIST,
+  SCRUB_FILE_CORRUPT,
+  SCRUB_FILE_CHANGED,
+  SCRUB_FILE_OK
+};
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Policy by which a source file is compared to a destination file (see --compare) */
+struct compare_policy
+{
+  const char * name;       /* name of policy (as specified on the command line), or NULL (at the end of the table) */
+  int needs;               /* bitwise-OR combination of COMPARE_NEEDS_* flags (what the comparison needs, beyond stat'ing) */
+  enum compare_files_result (* compare)(const char * src, const char * dst, const struct stat * src_stat,
+                                        const struct stat * dst_stat, long long window);
+};
+
+/* Files to sync (see process_files) */
+struct sync_job
+{
+  const char * src;        /* source directory pathname */
+  char ** dst;             /* destination directory pathnames */
+  int dst_count;           /* number of pathnames in dst */
+  int flags;               /* bitwise-OR combination of process_files flags */
+  char ** paths;           /* relative pathnames of files */
+  int path_count;          /* number of pathnames in paths */
+  size_t * sizes;          /* size (in bytes) of each source file */
+  time_t * mtimes;         /* modification time of each source file */
+  long * nsecs;            /* nanoseconds part of the modification time of each source file (or zero, if unknown) */
+  unsigned char * results; /* result (compare_files_result) of comparing each source file to each destination file */
+  int * copies;            /* indices of files that need to be copied */
+  int copy_count;          /* number of indices in copies */
+  long long * windows;     /* tolerance (see compare_times) for the modification time of files in each destination directory */
+  unsigned char * dst_devices; /* device (see device_find) of each destination directory (or NULL, if not scheduling) */
+  unsigned char * devices; /* device of each source file, followed by that of each of its destination files */
+  unsigned long long * masks; /* set of devices (see device_queue) touched by copying each file in copies */
+  unsigned char * hashes;  /* SHA-256 of each source file (or NULL, if no manifest is being written) */
+  char * hashed;           /* state (HASH_*) of the hash of each source file */
+  char * known;            /* nonzero for each source file whose size and time were input (or NULL, if none were) */
+  const time_t * epochs;   /* time before which source files are assumed synced to each destination (see read_epoch) */
+};
+
+/* Entries of a directory being purged (see purge_files) */
+struct purge_entries
+{
+  char ** names;    /* filenames (without path), each preceded by a byte that is nonzero if it is a directory */
+  int count;        /* number of filenames */
+  int size;         /* number of filenames for which memory is allocated */
+};
+
+#ifndef _WIN32
+/* Entry of a directory, as read by getdents64 (see purge_read) */
+struct purge_dirent
+{
+  unsigned long long ino;  /* inode number */
+  long long off;           /* offset of the next entry */
+  unsigned short reclen;   /* size (in bytes) of this entry */
+  unsigned char type;      /* type of file (DT_*) */
+  char name[1];            /* filename (null-terminated) */
+};
+#endif
+
+/* State of a purge (see purge_files) */
+struct purge_context
+{
+  struct pathset * paths; /* relative pathnames of files to skip (because they are known to exist in the source directory) */
+  struct spill * spill;   /* files to skip, if they were spilled to disk instead (in which case paths is NULL) */
+  int offset;     /* offset into absolute pathname of destination file at which to begin output */
+  int flags;      /* bitwise-OR combination of purge_files flags (PURGE_FILES_DELETE/PURGE_FILES_DRY_RUN) */
+  long limit;     /* number of files that may yet be deleted (or, if negative, there is no limit) */
+  int limited;    /* nonzero if any file was not deleted because of the limit */
+  int shard;      /* index of the shard to which files must belong to be reported (see path_shard) */
+  int shard_count;/* number of shards */
+  struct dircache * cache; /* record of destination directories that had nothing to purge (or NULL, if none is kept) */
+  struct purge_results * results; /* results of each thread, by number (or NULL, if the purge is not shared among them) */
+};
+
+/* Directory being purged (see purge_directory), as a task that any thread may do if the purge is shared among them */
+struct purge_task
+{
+  char src[JB_PATH_MAX_LENGTH];  /* source directory pathname */
+  char dst[JB_PATH_MAX_LENGTH];  /* destination directory pathname */
+  struct pathset_cursor cursor;  /* position in the files to skip (which only moves forward, as the directory is walked) */
+  int number;     /* number of the thread doing the task (or, if the purge is not shared among threads, negative) */
+  int dirty;      /* nonzero if anything was reported in the directory being purged (not counting its subdirectories) */
+};
+
+/* Destination directory that had nothing to purge, to be recorded in the directory cache */
+struct purge_record
+{
+  char * path;             /* absolute pathname of destination directory */
+  long long src_mtime;     /* modification time (in nanoseconds since 1970) of source directory */
+  long long dst_mtime;     /* modification time of destination directory */
+};
+
+/* What a thread reported while sharing a purge (to be output in order, and recorded, once the purge is done) */
+struct purge_results
+{
+  struct purge_entries reports;  /* relative pathnames of files reported (each preceded by a byte that is nonzero if it is
+                                  * a directory)
+                                  */
+  struct purge_record * records; /* destination directories that had nothing to purge */
+  int record_count;              /* number of items in records */
+  int record_size;               /* number of items for which memory is allocated */
+};
+
+/* Files to check against a manifest (see scrub_files) */
+struct scrub_job
+{
+  char ** dst;             /* destination directory pathnames */
+  int dst_count;           /* number of pathnames in dst */
+  const struct manifest_entry * entries; /* relative pathname and hash of each file (beginning at the cursor) */
+  int entry_count;         /* number of items in entries */
+  time_t mtime;            /* modification time of the manifest (files modified since then are changed, not corrupt) */
+  time_t deadline;         /* time after which no more files are to be scrubbed (or zero, if there is no limit) */
+  unsigned char * results; /* result (scrub_file_result) of scrubbing each file in each destination */
+  double * lengths;        /* number of bytes read of each file (from every destination) */
+};
+
+/* Directory being summarized (see index_files) */
+struct index_level
+{
+  struct sha256 sha;       /* hash (so far) of the entries of the directory */
+  int length;              /* length of the relative pathname of the directory (including its trailing separator, if any) */
+  int start;               /* index (into the sorted files) of the first file in the directory */
+  int complete;            /* nonzero if every file in the directory (so far) can be summarized */
+};
+
+/* Batch of files (or directories) in one directory to be deleted */
+struct delete_batch
+{
+#ifdef _WIN32
+  const char * dir; /* pathname of directory */
+#else
+  int dir;          /* file descriptor of directory (relative to which the files are deleted) */
+#endif
+  char ** names;    /* filenames (without path) */
+  char * failed;    /* for each filename, nonzero if the file could not be deleted */
+  int count;        /* number of filenames */
+  int size;         /* number of filenames for which memory is allocated */
 };
 
 
+
 /*************
  * Constants *
  *************/
 
-static const char * STR_USAGE = "SOURCE DEST";
+static const char * STR_USAGE = "SOURCE DEST...";
 static const char * STR_HELP =
-  "Synchronize (copy) newer files of corresponding names from SOURCE into DEST.\n"
+  "Synchronize (copy) newer files of corresponding names from SOURCE into each DEST.\n"
+  "(If there is more than one DEST, each pathname is output with its DEST number.)\n"
+  "(A pathname input may be followed by the file's size and time, in seconds since\n"
+  "1970, each after a tab, so that it need not be stat'ed in SOURCE.)\n"
   "Options:\n"
-  "  -h, --help     output this message and exit\n"
-  "  -n, --dry-run  don't actually copy files; just output messages\n"
-  "  -p, --purge    report files in destination directory to purge\n"
-  "  -v, --verbose  output messages for all files, whether copied or skipped";
+  "  -A, --apply=FILE    sync files as planned in FILE (instead of those input)\n"
+  "  -B, --memory=SIZE   keep no more than about SIZE bytes (or, with suffix K, M, or\n"
+  "                      G, KiB, MiB, or GiB) of files input in memory, spilling\n"
+  "                      the rest to temporary files (and syncing them in sorted\n"
+  "                      order)\n"
+  "  -b, --bwlimit=RATE  copy no more than RATE bytes per second (or, with suffix\n"
+  "                      K, M, or G, KiB, MiB, or GiB per second)\n"
+  "  -C, --coordinator=NAME\n"
+  "                      share the files input with worker processes (see --worker)\n"
+  "                      through shared memory object NAME, and report their totals\n"
+  "  -c, --compare=POLICY\n"
+  "                      copy a file according to POLICY: time (if it is newer in\n"
+  "                      SOURCE; the default), size (if its sizes differ), checksum\n"
+  "                      (if its contents differ), mirror (if its times or sizes\n"
+  "                      differ, even if it is newer in DEST), or never (unless\n"
+  "                      DEST lacks it)\n"
+  "  -D, --device-jobs=N copy no more than N files at a time to or from each device\n"
+  "                      (or, if N is auto, however many turn out to be fastest)\n"
+  "  -d, --delete        delete files in destination directory that would be purged\n"
+  "  -h, --help          output this message and exit\n"
+  "  -I, --idle          do disk I/O only when no other process needs the disk\n"
+  "  -i, --iops-limit=N  do no more than N I/O operations (stats, opens, reads,\n"
+  "                      writes, and deletes) per second\n"
+  "  -J, --journal=FILE  record the progress of the sync in FILE (see --resume)\n"
+  "  -j, --jobs=N        compare, copy, and delete files using N threads (default 1)\n"
+  "                      (or, if N is auto, however many turn out to be fastest)\n"
+  "  -K, --dir-cache=FILE\n"
+  "                      with --purge or --delete, record in FILE each directory in\n"
+  "                      DEST with nothing to purge, and next time, if neither it\n"
+  "                      nor the directory in SOURCE has been modified since, skip\n"
+  "                      checking its files\n"
+  "  -k, --spot-check=N  stat every Nth file whose size and time are input anyway, and\n"
+  "                      if they are wrong, say so (and go by its actual ones)\n"
+  "  -L, --slice=TIME    with --scrub, start no more files after TIME seconds (or,\n"
+  "                      with suffix m or h, minutes or hours), and next time,\n"
+  "                      resume from there (as recorded in MANIFEST.cursor)\n"
+  "  -l, --since-last    take files not modified since the last sync of every file\n"
+  "                      to a DEST (as recorded in it) to be synced already, without\n"
+  "                      stat'ing them there\n"
+  "  -M, --manifest=FILE write the SHA-256 of each file synced to FILE (in the format\n"
+  "                      of sha256sum), reusing those of unchanged files in FILE\n"
+  "  -m, --max-delete=N  don't delete more than N files\n"
+  "  -N, --nice=N        run at lower CPU priority (adding N to the niceness)\n"
+  "  -n, --dry-run       don't actually copy (or delete) files; just output messages\n"
+  "  -P, --plan=FILE     compare files and write a plan for syncing them to FILE\n"
+  "                      (implies --dry-run)\n"
+  "  -p, --purge         report files in destination directory to purge (the files\n"
+  "                      synced are kept in a compact path set for this, but the\n"
+  "                      sync itself still keeps each input pathname in memory)\n"
+  "  -Q, --sample        compare a few blocks of files of the same age and size (the\n"
+  "                      first, the last, and some at random), and copy any whose\n"
+  "                      contents differ (as when a file's time is restored after\n"
+  "                      editing it)\n"
+  "  -r, --pressure      whenever the system is under I/O or memory pressure, back\n"
+  "                      off (using fewer threads, and copying more slowly)\n"
+  "  -R, --resume        resume the interrupted sync recorded in the journal: skip\n"
+  "                      files already synced, and finish copying partial ones\n"
+  "  -S, --scrub=MANIFEST\n"
+  "                      instead of syncing, check the files in each DEST (given\n"
+  "                      without SOURCE) against MANIFEST (see --manifest), reading\n"
+  "                      them from disk to find any that have gone bad\n"
+  "  -s, --shard=I/N     sync (and purge) only the files whose pathnames hash to\n"
+  "                      shard I of N (so that N runs together do the whole job)\n"
+  "  -v, --verbose       output messages for all files, whether copied or skipped\n"
+  "  -V, --verify        read back each copy (from disk, not cache) to make sure that\n"
+  "                      it matches the source, and if it does not, copy it again\n"
+  "  -W, --worker=NAME   sync files shared by the coordinator (instead of those\n"
+  "                      input) through shared memory object NAME\n"
+  "  -x, --index=FILE    record in FILE a summary (hash) of the sizes and times of the\n"
+  "                      files synced in each directory, and next time, take those\n"
+  "                      in directories whose summaries match (given the sizes and\n"
+  "                      times input) to be synced already, without stat'ing them\n"
+  "  -w, --modify-window=SECONDS\n"
+  "                      treat files as the same age if their times differ by no\n"
+  "                      more than SECONDS (default: as fine as the filesystem of\n"
+  "                      DEST keeps them, e.g., 2 for FAT, or 0.0000001 for SMB)";
 static const char * STR_ERROR = "Error";
+static const char * STR_PLAN_DEST_FORMAT = "%s: plan is for %d DEST(s)\n";
 static const char * STR_PURGE = "\nThe following files in DEST may need to be purged:";
+static const char * STR_PURGE_FORMAT = "\nThe following files in DEST %d (%s) may need to be purged:\n";
+static const char * STR_DELETE_HEADING = "\nThe following files in DEST are to be deleted:";
+static const char * STR_DELETE_FORMAT = "\nThe following files in DEST %d (%s) are to be deleted:\n";
+static const char * STR_DELETE = "Delete";
+static const char * STR_OVER_LIMIT = "Skip (over limit)";
+static const char * STR_LIMITED = "\nNot all files were deleted, because doing so would have exceeded the limit.";
+static const char * STR_WORKERS_HEADING =
+  "\nWorker     PID         Files      Copied            Bytes      Errors\n"
+  "------  --------  ----------  ----------  ---------------  ----------";
+static const char * STR_WORKERS_FORMAT = "%6d  %8ld  %10lld  %10lld  %15lld  %10lld%s\n";
+static const char * STR_WORKERS_TOTAL = "Total             %10lld  %10lld  %15lld  %10lld\n";
+static const char * STR_UNFINISHED = "  (unfinished)";
+static const char * STR_SPOT_CHECK_FORMAT = "%s: source file is not as input (size %.0f, time %lld.%09ld)\n";
+static const char * STR_VERIFY_FORMAT = "%s: copy does not match source (CRC-32C %08X, not %08X)\n";
+static const char * STR_UNVERIFIED_FORMAT = "%s: copy could not be read back\n";
+static const char * STR_SCRUB_FORMAT = "\nScrubbed %d file(s) (%.0f bytes read); %d did not match the manifest.\n";
+static const char * STR_SCRUB_CURSOR_FORMAT = "(Out of time: the next scrub will resume after %s.)\n";
+static const char * STR_SCRUB_FINISHED = "(That finishes the manifest: the next scrub will begin again at the start.)";
+static const char * STR_SCRUB_OK = "OK";
+static const char * STR_SCRUB_NO_EXIST = "Not found";
+static const char * STR_SCRUB_CORRUPT = "Corrupt!";
+static const char * STR_SCRUB_CHANGED = "Changed since";
 
 /* Terse messages */
 static const char * STR_TERSE_HEADING =
@@ -73,6 +361,11 @@ static const char * STR_TERSE_HEADING =
 static const char * STR_NEW                                 = "New";
 static const char * STR_LARGER                              = "Newer and larger";
 static const char * STR_NEWER                               = "Newer (not larger)";
+static const char * STR_PARTIAL                             = "Incomplete";
+static const char * STR_DIFFERENT                           = "Changed (same age)";
+static const char * STR_SIZE_DIFFERS                        = "Different size";
+static const char * STR_CONTENTS_DIFFER                     = "Different contents";
+static const char * STR_REPLACE                             = "Replaces newer";
 
 /* Verbose messages */
 static const char * STR_VERBOSE_HEADING =
@@ -86,26 +379,215 @@ static const char * STR_SAME_AGE                    = "Same age . . . . . . Skip
 static const char * STR_DST_NEWER                   = "Dst newer! . . . . . Skip";
 static const char * STR_SRC_LARGER                  = "Src newer & larger . Copy";
 static const char * STR_SRC_NEWER                   = "Src newer. . . . . . Copy";
+static const char * STR_DST_PARTIAL                 = "Dst incomplete . . . Copy";
+static const char * STR_DIFFERENT_CONTENT           = "Content differs. . . Copy";
+static const char * STR_SAME_SIZE                   = "Same size. . . . . . Skip";
+static const char * STR_DIFFERENT_SIZE              = "Size differs . . . . Copy";
+static const char * STR_SAME_CONTENTS               = "Same contents. . . . Skip";
+static const char * STR_DST_REPLACE                 = "Dst newer. . . . . . Copy";
+static const char * STR_DST_EXISTS                  = "Dst exists . . . . . Skip";
+static const char * STR_UNCHANGED                   = "Unchanged. . . . . . Skip";
 
 
 /*********************
  * Macro Definitions *
  *********************/
 
-/* Flags for process_file */
-#define PROCESS_FILE_VERBOSE  0x1
-#define PROCESS_FILE_DRY_RUN  0x2
+/* Flags for process_files */
+#define PROCESS_FILES_VERBOSE  0x1
+#define PROCESS_FILES_DRY_RUN  0x2
+#define PROCESS_FILES_PLANNED  0x4
+
+/* What a comparison policy needs to know of a source file and a destination file, beyond what stat'ing them reveals (their
+ * existence, types, and sizes): whether their modification times matter (in which case the tolerance for those of each
+ * destination directory is found), and whether their contents are read (in which case comparing is limited by bandwidth).
+ */
+#define COMPARE_NEEDS_MTIME     0x1
+#define COMPARE_NEEDS_CONTENTS  0x2
+
+/* Flags for purge_files */
+#define PURGE_FILES_DELETE   0x1
+#define PURGE_FILES_DRY_RUN  0x2
+
+/* Size (in bytes) of the buffer into which the entries of a directory are read by purge_read (as many at a time as fit) */
+#define PURGE_READ_SIZE 0x100000  /* 1 MiB */
+
+/* Type of an entry of a directory being purged that is not yet known to be a directory or not (see purge_read) */
+#define PURGE_ENTRY_UNKNOWN 2
+
+/* Maximum number of destination directories */
+#define MAX_DEST_COUNT 16
+
+/* Size (in bytes) of each block read from a source file by copy_file */
+#define COPY_BLOCK_SIZE 0x100000  /* 1 MiB */
+
+/* Number of bytes copied (of a large file) between each record of progress in the journal */
+#define COPY_CHECKPOINT_SIZE 0x4000000  /* 64 MiB */
+
+/* Number of times to copy a file again if a copy of it fails verification */
+#define COPY_VERIFY_ATTEMPTS 2
+
+/* Size (in bytes) of each block compared by compare_contents, and the number of blocks sampled (counting the first and last) */
+#define SAMPLE_BLOCK_SIZE   0x10000  /* 64 KiB */
+#define SAMPLE_BLOCK_COUNT  6
+
+/* Size (in bytes) of each block read from a destination file by scrub_file */
+#define SCRUB_BLOCK_SIZE 0x400000  /* 4 MiB */
+
+/* Name of the file in a destination directory recording when it was last synced in full (see read_epoch), and how long
+ * (in seconds) before then a source file must have been modified to be assumed synced (in case clocks differ)
+ */
+#define EPOCH_FILE_NAME  ".plunge-epoch"
+#define EPOCH_MARGIN     300
+
+/* State of the hash of a source file (see manifest_files) */
+#define HASH_UNKNOWN  0
+#define HASH_KNOWN    1
+#define HASH_NEEDED   2
+
+/* Nanoseconds part of the modification time of a file that has been stat'ed (which Windows does not provide) */
+#ifdef _WIN32
+#  define STAT_MTIME_NSEC(st)  0
+#else
+#  define STAT_MTIME_NSEC(st)  ((st).st_mtim.tv_nsec)
+#endif
+
+/* Filesystem types (as reported by statfs) whose timestamps are coarser than a nanosecond (see mtime_window) */
+#define FS_TYPE_MSDOS  0x4D44      /* FAT: 2 seconds */
+#define FS_TYPE_EXFAT  0x2011BAB0  /* exFAT: 2 seconds (for compatibility with FAT) */
+#define FS_TYPE_CIFS   0xFF534D42  /* SMB (version 1): 100 nanoseconds */
+#define FS_TYPE_SMB2   0xFE534D42  /* SMB (version 2 or 3): 100 nanoseconds */
+#define FS_TYPE_SMB    0x517B      /* SMB (the old smbfs): 100 nanoseconds */
+#define FS_TYPE_NTFS   0x5346544E  /* NTFS: 100 nanoseconds */
+#define FS_TYPE_NTFS3  0x7366746E  /* NTFS (the ntfs3 driver): 100 nanoseconds */
+
+/* Portable 64-bit seek, flush to disk, eviction (of a file that has been flushed) from cache, and hint that a file will be
+ * read sequentially (so that more of it is read ahead).  (Windows cannot evict a file from cache without reopening it
+ * unbuffered, which requires aligned reads, so there the file is read as it is, with the usual read-ahead.)
+ */
+#ifdef _WIN32
+#  define FILE_SEEK(f, offset)  _fseeki64((f), (offset), SEEK_SET)
+#  define FILE_SYNC(f)          _commit(_fileno(f))
+#  define FILE_EVICT(f)         0
+#  define FILE_SEQUENTIAL(f)    0
+#else
+#  define FILE_SEEK(f, offset)  fseeko((f), (off_t)(offset), SEEK_SET)
+#  define FILE_SYNC(f)          fsync(fileno(f))
+#  define FILE_EVICT(f)         posix_fadvise(fileno(f), 0, 0, POSIX_FADV_DONTNEED)
+#  define FILE_SEQUENTIAL(f)    posix_fadvise(fileno(f), 0, 0, POSIX_FADV_SEQUENTIAL)
+#endif
 
 
 /*********************************
  * Private Function Declarations *
  *********************************/
 
-void process_file(const char * path, const char * src, const char * dst, int flags);
-enum compare_files_result compare_files(const char * src, const char * dst, size_t * size_ptr, time_t * mtime_ptr);
-void copy_file(const char * src, const char * dst, size_t size, time_t mtime);
-void purge_files(const char * src, const char * dst, int offset, char ** paths, int path_count);
-void purge_file(const char * name, int dir, const char * src, const char * dst, int offset, char ** paths, int path_count);
+void process_files(struct sync_job * job);
+void process_shared(struct share * share, struct sync_job * job);
+void report_workers(struct share * share, int count);
+int process_spilled(struct spill * spill, struct sync_job * job, double budget);
+int process_file(struct sync_job * job, int index);
+int process_result(enum compare_files_result result, int verbose, const char ** message_ptr);
+void compare_file(void * context, int index);
+void sync_file(void * context, int index);
+void manifest_files(struct sync_job * job);
+void hash_file(void * context, int index);
+void index_files(struct sync_job * job, int synced);
+void index_directory(struct sync_job * job, struct index_level * level, const char * path, const int * sorted, int end,
+                     int synced);
+int synced_file(struct sync_job * job, int index);
+int sync_job_allocate(struct sync_job * job, char ** paths, int dst_count, int path_count);
+void sync_job_known(struct sync_job * job, const size_t * sizes, const time_t * mtimes, const long * nsecs);
+size_t sync_job_memory(const char * path, int dst_count);
+void sync_job_free(struct sync_job * job);
+int write_plan(const char * path, struct sync_job * job);
+int scrub_files(const char * path, char ** dst, int dst_count, double slice, int verbose);
+void scrub_file(void * context, int index);
+double parse_rate(const char * s);
+double parse_duration(const char * s);
+int parse_input(char * s, size_t * size_ptr, time_t * mtime_ptr, long * nsec_ptr);
+int compare_paths(const void * a, const void * b);
+void compare_files(const char * src, char dst[][JB_PATH_MAX_LENGTH], int dst_count, const long long * windows,
+                   const time_t * epochs, enum compare_files_result * results, size_t * size_ptr, time_t * mtime_ptr,
+                   long * nsec_ptr, unsigned char * devices, int known);
+enum compare_files_result compare_by_time(const char * src, const char * dst, const struct stat * src_stat,
+                                          const struct stat * dst_stat, long long window);
+enum compare_files_result compare_by_size(const char * src, const char * dst, const struct stat * src_stat,
+                                          const struct stat * dst_stat, long long window);
+enum compare_files_result compare_by_checksum(const char * src, const char * dst, const struct stat * src_stat,
+                                              const struct stat * dst_stat, long long window);
+enum compare_files_result compare_for_mirror(const char * src, const char * dst, const struct stat * src_stat,
+                                             const struct stat * dst_stat, long long window);
+enum compare_files_result compare_never(const char * src, const char * dst, const struct stat * src_stat,
+                                        const struct stat * dst_stat, long long window);
+int compare_times(time_t a, long a_nsec, time_t b, long b_nsec, long long window);
+long long mtime_window(const char * dir);
+time_t read_epoch(const char * dir);
+int write_epoch(const char * dir, time_t epoch);
+int compare_contents(const char * src, const char * dst, size_t size, int sampled);
+int copy_file(const char * src, const char ** dst, int dst_count, size_t size, time_t mtime, long nsec,
+              size_t offset, const char * path, unsigned int dsts, int attempts, unsigned char * hash);
+int touch_file(const char * path, time_t mtime, long nsec);
+int verify_file(const char * path, size_t offset, void * buffer, size_t size, unsigned int * crc_ptr, size_t * length_ptr);
+void purge_directory(void * context, void * task, int number);
+int purge_files(const char * src, const char * dst, struct purge_context * context, struct purge_task * task);
+int purge_file(const char * name, int dir, const char * src, const char * dst, struct purge_context * context,
+               struct purge_task * task);
+int purge_find(struct purge_context * context, struct purge_task * task, const char * path, int prefix);
+int purge_read(int dir, struct purge_entries * entries);
+void purge_record(struct purge_context * context, struct purge_task * task, const char * dst, long long src_mtime,
+                  long long dst_mtime);
+void purge_output(struct purge_context * context);
+void purge_entries_add(struct purge_entries * entries, const char * name, int dir);
+void purge_entries_free(struct purge_entries * entries);
+int compare_purge_entries(const void * a, const void * b);
+void delete_batch_add(struct delete_batch * batch, const char * name);
+void delete_batch_free(struct delete_batch * batch);
+void delete_file(void * context, int index);
+int delete_directory(struct delete_batch * batch, int index);
+
+
+/*********************
+ * Private Variables *
+ *********************/
+
+/* Pathnames being sorted (see compare_paths) */
+static char ** sort_paths;
+
+/* Journal of the progress of the sync (or NULL, if none) */
+static struct journal * journal;
+
+/* Nonzero if each copy is to be verified (see copy_file) */
+static int verify;
+
+/* Comparison policies (the first of which is the default) */
+static const struct compare_policy policies[] =
+{
+  { "time",     COMPARE_NEEDS_MTIME,    compare_by_time },
+  { "size",     0,                      compare_by_size },
+  { "checksum", COMPARE_NEEDS_CONTENTS, compare_by_checksum },
+  { "mirror",   COMPARE_NEEDS_MTIME,    compare_for_mirror },
+  { "never",    0,                      compare_never },
+  { NULL }
+};
+
+/* Policy by which files are compared (see compare_files) */
+static const struct compare_policy * policy;
+
+/* Nonzero if files of the same age are to be compared by sampling their contents (see compare_by_time) */
+static int sample;
+
+/* Every Nth source file whose size and time were input is stat'ed anyway, to check them (or, if zero, none is) */
+static long spot_check;
+
+/* Manifest to which the hash of each file synced is added (or NULL, if none) */
+static struct manifest * manifest;
+
+/* Index of the summary of each directory synced, as a manifest of directories (see index_files; or NULL, if none) */
+static struct manifest * dir_index;
+
+/* Limits on the number of bytes copied, and of I/O operations done, per second (shared by every thread) */
+static struct limit bandwidth, operations;
 
 
 /*************
@@ -114,7 +596,8 @@ void purge_file(const char * name, int dir, const char * src, const char * dst,
 
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
- * Synchronize files by copying newer files of corresponding names from a source directory into a destination directory.
+ * Synchronize files by copying newer files of corresponding names from a source directory into one or more destination
+ * directories.  (Each source file that needs to be copied is read only once, no matter how many destinations need it.)
  */
 int main(int argc, char * argv[])
 {
@@ -122,37 +605,259 @@ int main(int argc, char * argv[])
 
   static struct jb_command_option options[] =
   {
-    { { "verbose", "v" }, 0 },
-    { { "dry-run", "n" }, 0 },
-    { { "purge",   "p" }, 0 }
+    { { "verbose",      "v" }, 0 },
+    { { "dry-run",      "n" }, 0 },
+    { { "purge",        "p" }, 0 },
+    { { "delete",       "d" }, 0 },
+    { { "jobs=",        "j" }, 0 },
+    { { "max-delete=",  "m" }, 0 },
+    { { "plan=",        "P" }, 0 },
+    { { "apply=",       "A" }, 0 },
+    { { "shard=",       "s" }, 0 },
+    { { "coordinator=", "C" }, 0 },
+    { { "worker=",      "W" }, 0 },
+    { { "journal=",     "J" }, 0 },
+    { { "resume",       "R" }, 0 },
+    { { "bwlimit=",     "b" }, 0 },
+    { { "iops-limit=",  "i" }, 0 },
+    { { "idle",         "I" }, 0 },
+    { { "nice=",        "N" }, 0 },
+    { { "pressure",     "r" }, 0 },
+    { { "device-jobs=", "D" }, 0 },
+    { { "verify",       "V" }, 0 },
+    { { "manifest=",    "M" }, 0 },
+    { { "scrub=",       "S" }, 0 },
+    { { "slice=",       "L" }, 0 },
+    { { "sample",       "Q" }, 0 },
+    { { "modify-window=", "w" }, 0 },
+    { { "compare=",     "c" }, 0 },
+    { { "spot-check=",  "k" }, 0 },
+    { { "since-last",   "l" }, 0 },
+    { { "dir-cache=",   "K" }, 0 },
+    { { "index=",       "x" }, 0 },
+    { { "memory=",      "B" }, 0 }
   };
 
-  int n, i, b = 0;
-  char s[JB_PATH_MAX_LENGTH], * p, * q, ** a = NULL;
+  int n, m, i, j, failed = 0;
+  char s[JB_PATH_MAX_LENGTH], * p, ** q, ** a = NULL;
+  size_t l, * zs = NULL;
+  time_t h, * ts = NULL;
+  long r, * ns = NULL;
+  unsigned char d[MAX_DEST_COUNT + 1];
+  long long g[MAX_DEST_COUNT];
+  time_t b = time(NULL), f[MAX_DEST_COUNT];
+  struct sync_job job = { 0 };
+  struct purge_context c = { 0 };
+  struct stat st;
+  long x = 0, y = 1, z = 0, w = 0;
+  double u = 0, v = 0, t = 0, o = -1, budget = 0, spent = 0;
+  struct plan * plan = NULL;
+  struct share * share = NULL;
+  struct spill * spill = NULL;
+  struct purge_task * task;
+  const struct journal_entry * e;
 
   /* Verify usage. */
   n = sizeof(options) / sizeof(struct jb_command_option);
-  n = jb_command_parse(argc, argv, STR_USAGE, STR_HELP, options, n, 2);
+  n = jb_command_parse(argc, argv, STR_USAGE, STR_HELP, options, n, -1);
   if (n < 0) return (n == INT_MIN) ? EXIT_SUCCESS : EXIT_FAILURE;
 
-  /* Input the relative pathname of each file to sync (one per line). */
-  for (i = 0; fgets(s, JB_PATH_MAX_LENGTH, stdin); ++i)
+  /* The first argument is the source directory; the rest (of which there is a limited number) are destination directories.
+   * (When scrubbing, there is no source directory, so every argument is a destination directory.)
+   */
+  if ((m = n - 1) > MAX_DEST_COUNT || (m < 1 && !options[21].argument))
+  {
+    jb_command_error(argv[0], STR_USAGE); return EXIT_FAILURE;
+  }
+
+  /* If specified, the number of jobs must be positive (or auto), the deletion limit must not be negative, and the shard
+   * must be of the form I/N (where 0 <= I < N).  (Also, a plan cannot be written and applied at the same time, nor
+   * can either be done by a coordinator or worker; a process cannot be both; a worker cannot purge files; and there
+   * is nothing to resume without a journal.)  Likewise, the bandwidth and I/O operation limits must be positive, the
+   * niceness increment must be between 1 and 19, the number of jobs per device must be positive (or auto), and the
+   * modification time tolerance must not be negative.  The comparison policy must be one of those known (and only the
+   * default one, which compares times, can sample contents to catch files that were changed without changing their times).
+   * Spot checks must be of every Nth file (where N is positive), and a directory cache is kept only for a (whole) purge.
+   * An index is only for the files input (not those of a plan, or of a coordinator).  Likewise, the memory allowed must be
+   * positive, and only the files input can be spilled to disk (when they need not all be at hand at once, as they do for
+   * a plan, a coordinator, or an index).
+   * Finally, a scrub is all a process does (so it cannot purge, journal, or write a manifest), and only a scrub can be sliced.
+   */
+  n = (options[4].argument && !strcmp(options[4].argument, "auto")) ? TUNE_MAX_JOBS : 1;
+  for (policy = policies; options[25].argument && policy->name && strcmp(policy->name, options[25].argument); ++policy);
+  c.limit = options[5].argument ? strtol(options[5].argument, &p, 10) : -1;
+  i = (options[6].argument != NULL) + (options[7].argument != NULL) + (options[9].argument != NULL) + (options[10].argument != NULL) +
+      (options[21].argument != NULL);
+  if ((options[5].argument && (*p || c.limit < 0)) || i > 1 ||
+      (options[4].argument && strcmp(options[4].argument, "auto") &&
+       ((r = strtol(options[4].argument, &p, 10)) < 1 || r > WORK_MAX_JOBS || *p || !(n = (int)r))) ||
+      (options[10].argument && (options[2].is_present || options[3].is_present)) || (options[12].is_present && !options[11].argument) ||
+      (options[13].argument && (u = parse_rate(options[13].argument)) <= 0) ||
+      (options[14].argument && ((v = strtod(options[14].argument, &p)) <= 0 || *p)) ||
+      (options[16].argument && ((z = strtol(options[16].argument, &p, 10)) < 1 || z > 19 || *p)) ||
+      (options[18].argument && strcmp(options[18].argument, "auto") &&
+       ((w = strtol(options[18].argument, &p, 10)) < 1 || w > WORK_MAX_JOBS || *p)) ||
+      (options[8].argument && ((x = strtol(options[8].argument, &p, 10)) < 0 || *p != '/' ||
+                               (y = strtol(p + 1, &p, 10)) <= x || *p || y > INT_MAX)) ||
+      (options[21].argument && (options[2].is_present || options[3].is_present || options[11].argument || options[20].argument)) ||
+      (options[22].argument && (!options[21].argument || (t = parse_duration(options[22].argument)) <= 0)) ||
+      (options[24].argument && ((o = strtod(options[24].argument, &p)) < 0 || *p)) ||
+      !policy->name || (options[23].is_present && policy != policies) ||
+      (options[26].argument && ((spot_check = strtol(options[26].argument, &p, 10)) < 1 || *p)) ||
+      (options[28].argument && ((!options[2].is_present && !options[3].is_present) || options[8].argument)) ||
+      (options[29].argument && (options[7].argument || options[9].argument || options[10].argument)) ||
+      (options[30].argument && ((budget = parse_rate(options[30].argument)) <= 0 || options[6].argument ||
+                                options[7].argument || options[9].argument || options[10].argument || options[29].argument)))
+  {
+    jb_command_error(argv[0], STR_USAGE); return EXIT_FAILURE;
+  }
+  c.shard = (int)x;
+  c.shard_count = (int)y;
+  limit_init(&bandwidth, u);
+  limit_init(&operations, v);
+
+  /* If specified, lower the I/O (and/or CPU) priority of this process.  (This must be done before the worker threads are
+   * started, so that they inherit it.)  If that cannot be done, say so, but sync anyway.
+   */
+  if (options[15].is_present) limit_idle();
+  if (z) limit_nice((int)z);
+  work_start(n);
+
+  /* If there is more than one job, share a purge among the threads (each directory being a task), unless there is a deletion
+   * limit (which must be applied in order).  Each thread keeps what it reports, so that it can all be output in order.
+   */
+  if (n > 1 && c.limit < 0 && (options[2].is_present || options[3].is_present) &&
+      !(c.results = (struct purge_results *)calloc(WORK_MAX_JOBS + 1, sizeof(struct purge_results))))
+  {
+    perror("calloc"); return EXIT_FAILURE;
+  }
+
+  /* If specified, adapt to pressure on the system.  (If that cannot be done, say so, but sync anyway.) */
+  if (options[17].is_present) pressure_start(n, &bandwidth, &operations);
+
+  /* If specified, tune the number of threads automatically (rather than using them all). */
+  if (options[4].argument && !strcmp(options[4].argument, "auto")) tune_start(n, &operations, &bandwidth);
+
+  /* If specified, limit the number of copies in flight to or from each device (or, if auto, tune it for each device). */
+  if (options[18].argument) device_start((int)w, n);
+
+  /* If specified, verify each copy (and/or sample the contents of files of the same age). */
+  if (verify = options[19].is_present) crc_init();
+  sample = options[23].is_present;
+
+  /* If specified, scrub the destination directories (instead of syncing anything). */
+  if (options[21].argument)
+  {
+    i = scrub_files(options[21].argument, &argv[argc - m - 1], m + 1, t, options[0].is_present);
+    work_stop();
+    return i ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+  /* If specified, open the journal (loading it, if resuming).  Nothing is recorded in it if nothing is to be copied. */
+  if (options[11].argument &&
+      !(journal = journal_open(options[11].argument, options[12].is_present, !options[1].is_present && !options[6].argument)))
+  {
+    return EXIT_FAILURE;
+  }
+
+  /* If specified, open the manifest (loading the hashes already in it, so that those of unchanged files can be reused). */
+  if (options[20].argument && !(manifest = manifest_open(options[20].argument, 1))) return EXIT_FAILURE;
+
+  /* If specified, open the directory cache (loading the directories that had nothing to purge the last time). */
+  if (options[28].argument && !(c.cache = dircache_open(options[28].argument))) return EXIT_FAILURE;
+
+  /* If specified, open the index (loading the summary of each directory as of the last sync).  It is replaced only if files
+   * are actually synced (so for a dry run, it need not exist).
+   */
+  i = !options[1].is_present && !options[6].argument;
+  if (options[29].argument && (i || !stat(options[29].argument, &st)) && !(dir_index = manifest_open(options[29].argument, i)))
+  {
+    return EXIT_FAILURE;
+  }
+
+  /* If a plan is to be applied, input the relative pathname (and comparison results, etc.) of each file to sync from it. */
+  if (options[7].argument)
   {
-    /* Skip empty lines. */
-    if ((n = strlen(p = jb_trim(s))) < 1) continue;
+    if (!(plan = plan_open(options[7].argument, &j, &n))) return EXIT_FAILURE;
+    if (j != m) { fprintf(stderr, STR_PLAN_DEST_FORMAT, options[7].argument, j); plan_close(plan); return EXIT_FAILURE; }
+    if (!(a = (char **)malloc(((size_t)n + 1) * k))) { perror("malloc"); plan_close(plan); return EXIT_FAILURE; }
+    if (sync_job_allocate(&job, a, m, n)) { plan_close(plan); return EXIT_FAILURE; }
+    for (i = j = 0; j < n; ++j)
+    {
+      if (plan_get(plan, s, &job.results[i * m], &job.sizes[i], &job.mtimes[i])) { plan_close(plan); return EXIT_FAILURE; }
+
+      /* If the file belongs to another shard (or, if resuming, was already synced), skip it. */
+      if (path_shard(s, c.shard_count) != c.shard || (journal && (e = journal_find(journal, s)) && e->complete)) continue;
+      if (!(a[i] = (char *)malloc(l = strlen(s) + 1))) { perror("malloc"); plan_close(plan); return EXIT_FAILURE; }
+      memcpy(a[i++], s, l);
+    }
+    job.path_count = i;
+    if (plan_close(plan)) return EXIT_FAILURE;
+    job.flags |= PROCESS_FILES_PLANNED;
+  }
 
-    /* Allocate memory for another character pointer at the end of our array. */
-    a = (char **)realloc(a, (i + 1) * k);
+  /* If this is a worker, the files to sync are those shared by the coordinator (so there is nothing to input). */
+  else if (options[10].argument)
+  {
+    if (!(share = share_attach(options[10].argument)) || sync_job_allocate(&job, NULL, m, 0)) return EXIT_FAILURE;
+  }
 
-    /* Allocate memory for a new string and copy the relative pathname of the file into it. */
-    memcpy((a[i] = (char *)malloc(JB_PATH_MAX_LENGTH)), p, ++n);
+  /* Otherwise, input the relative pathname of each file to sync (one per line), and its size and time, if given. */
+  else
+  {
+    if (options[30].argument && !(spill = spill_create())) return EXIT_FAILURE;
+    for (i = 0; fgets(s, JB_PATH_MAX_LENGTH, stdin); ++i)
+    {
+      /* Skip empty lines (and files that belong to other shards). */
+      j = parse_input(p = jb_trim(s), &l, &h, &r);
+      if ((n = strlen(p)) < 1 || path_shard(p, c.shard_count) != c.shard) { --i; continue; }
+
+      /* Allocate memory for another character pointer at the end of our array (and for the size and time of the file,
+       * which are noted until the job is allocated, with a negative nanoseconds part if they were not given).
+       */
+      a = (char **)realloc(a, (i + 1) * k);
+      zs = (size_t *)realloc(zs, (i + 1) * sizeof(size_t));
+      ts = (time_t *)realloc(ts, (i + 1) * sizeof(time_t));
+      ns = (long *)realloc(ns, (i + 1) * sizeof(long));
+      zs[i] = l; ts[i] = h; ns[i] = j ? r : -1;
+
+      /* Allocate memory for a new string and copy the relative pathname of the file into it. */
+      a[i] = (char *)malloc(++n);
+      memcpy(a[i], p, n);
 
 #ifdef _WIN32
-    /* Replace any slashes in the pathname with the platform-dependent directory separator. */
-    for (p = a[i]; *p; ++p) if (*p == '/') *p = JB_PATH_SEPARATOR;
+      /* Replace any slashes in the pathname with the platform-dependent directory separator. */
+      for (p = a[i]; *p; ++p) if (*p == '/') *p = JB_PATH_SEPARATOR;
 #endif
+
+      /* If resuming, skip files that were already synced (without so much as stat'ing them). */
+      if (journal && (e = journal_find(journal, a[i])) && e->complete) { free(a[i--]); continue; }
+
+      /* If the files input so far take up the memory allowed, spill them to disk (and start over). */
+      if (!spill || (spent += sync_job_memory(a[i], m)) < budget) continue;
+      if (spill_put(spill, a, zs, ts, ns, i + 1)) return EXIT_FAILURE;
+      for (j = 0; j <= i; ++j) free(a[j]);
+      i = -1; spent = 0;
+    }
+
+    /* If any files were spilled, spill the rest too (so that they can all be synced in sorted order; see process_spilled).
+     * Otherwise, they all fit in memory after all.
+     */
+    if (spill && spill->run_count)
+    {
+      if (i && spill_put(spill, a, zs, ts, ns, i)) return EXIT_FAILURE;
+      for (j = 0; j < i; ++j) free(a[j]);
+      i = 0;
+    }
+    else if (spill) { spill_close(spill); spill = NULL; }
+    if (!a && c.shard_count == 1) return EXIT_SUCCESS;
+    if (sync_job_allocate(&job, a, m, i)) return EXIT_FAILURE;
+    sync_job_known(&job, zs, ts, ns);
+    free(zs); free(ts); free(ns);
+
+    /* If this is the coordinator, share the files with the workers. */
+    if (options[9].argument && !(share = share_create(options[9].argument, a, i))) return EXIT_FAILURE;
   }
-  if (!a) return EXIT_SUCCESS;
 
 #ifndef _WIN32
   /* Output an empty line before the heading, to improve readability.
@@ -164,23 +869,119 @@ int main(int argc, char * argv[])
   /* Output the appropriate heading. */
   puts(options[0].is_present ? STR_VERBOSE_HEADING : STR_TERSE_HEADING);
 
-  /* Process each file that was entered. */
-  n = i;
-  p = argv[argc - 2];
-  q = argv[argc - 1];
-  if (options[0].is_present) b |= PROCESS_FILE_VERBOSE;
-  if (options[1].is_present) b |= PROCESS_FILE_DRY_RUN;
-  for (i = 0; i < n; ++i) process_file(a[i], p, q, b);
+  /* Process each file that was entered.  (If a plan is to be written, nothing is actually copied (or deleted).) */
+  n = job.path_count;
+  p = argv[argc - m - 1];
+  q = &argv[argc - m];
+  job.src = p;
+  job.dst = q;
+
+  /* If copies are to be scheduled by device, find the device of each destination directory, followed by that of the source
+   * directory.  (A destination file that does not exist yet is assumed to be on that device, as is a source file that is not
+   * stat'ed.)  When a plan is applied, the files are not stat'ed, so their devices are unknown, and they are not scheduled
+   * by device.
+   */
+  if (options[18].argument && !(job.flags & PROCESS_FILES_PLANNED))
+  {
+    for (j = 0; j < m; ++j) d[j] = stat(q[j], &st) ? 0 : (unsigned char)device_find(st.st_dev);
+    d[m] = stat(p, &st) ? 0 : (unsigned char)device_find(st.st_dev);
+    job.dst_devices = d;
+  }
+
+  /* If the comparison policy needs modification times, find the tolerance for those of the files in each destination
+   * directory: as specified, or else as coarse as the filesystem of the directory keeps them (so that files copied to it
+   * compare as the same age).
+   */
+  for (j = 0; j < m; ++j)
+  {
+    g[j] = !(policy->needs & COMPARE_NEEDS_MTIME) ? 0 : (o >= 0) ? (long long)(o * 1e9 + 0.5) : mtime_window(q[j]);
+  }
+  job.windows = g;
+
+  /* If specified, find when each destination directory was last synced in full, so that source files modified before then
+   * need not be compared to it.
+   */
+  if (options[27].is_present)
+  {
+    for (j = 0; j < m; ++j) f[j] = read_epoch(q[j]);
+    job.epochs = f;
+  }
+  if (options[0].is_present) job.flags |= PROCESS_FILES_VERBOSE;
+  if (options[1].is_present || options[6].argument) job.flags |= PROCESS_FILES_DRY_RUN;
+
+  /* If there is an index (and the sizes and times of files were input), files in directories whose summaries match it need
+   * not be compared.  Once the files are synced, the summaries of their directories are put in the index.
+   */
+  if (dir_index && job.known) index_files(&job, 0);
+  if (!share && !spill) process_files(&job);
+
+  /* If the files were spilled to disk, get them back a batch at a time (as many as fit in the memory allowed). */
+  else if (!share) failed = process_spilled(spill, &job, budget);
+
+  /* If the files are shared, claim batches of them until there are none left (and, if this is the coordinator, wait
+   * for the workers to finish theirs too, redo the batch of any worker that exited without finishing, and then report
+   * their totals).
+   */
+  else
+  {
+    process_shared(share, &job);
+    j = share_finish(share);
+    if (options[9].argument) process_shared(share, &job);
+    if (options[9].argument) report_workers(share, j);
+    share_close(share);
+  }
+  if (dir_index && !(job.flags & PROCESS_FILES_DRY_RUN)) index_files(&job, 1);
+
+  /* If specified, and every file was synced in full (not just a shard, nor the rest of an interrupted sync, and without
+   * error), record when this sync began in each destination directory, for the next one.
+   */
+  if (options[27].is_present && !share && !failed && c.shard_count == 1 && !options[12].is_present &&
+      !(job.flags & (PROCESS_FILES_DRY_RUN | PROCESS_FILES_PLANNED)))
+  {
+    for (i = 0; i < n * m && job.results[i] != COMPARE_FILES_ERROR; ++i);
+    for (j = 0; i == n * m && j < m; ++j) write_epoch(q[j], b);
+  }
+
+  /* If specified, write the plan (with its pathnames in sorted order, to make the most of front coding). */
+  if (options[6].argument && write_plan(options[6].argument, &job)) return EXIT_FAILURE;
 
-  /* If specified, report files in the destination directory that may need to be purged.
-   * (This requires absolute pathnames of source files to determine whether or not to skip them.)
+  /* If specified, report (or delete) files in each destination directory that may need to be purged.  (Source files that
+   * were synced are skipped without being stat'ed; to find them quickly, their pathnames are put in a path set, unless
+   * they were spilled to disk.  Either way, they are merged with the files in each destination directory, in order.
+   * Files spilled to disk can only be merged with one directory at a time, though, so then the purge is not shared.)
+   * Once the path set is built, the job is done with, so its pathnames (and the rest of it) are freed right away.
    */
-  if (options[2].is_present)
+  if (options[2].is_present || options[3].is_present)
   {
-    puts(STR_PURGE);
-    for (i = 0; i < n; ++i) path_build(a[i], p, a[i]);
-    if (q[(i = strlen(q)) - 1] != JB_PATH_SEPARATOR) ++i;
-    purge_files(p, q, i, a, n);
+    if (options[3].is_present) c.flags |= PURGE_FILES_DELETE;
+    if (job.flags & PROCESS_FILES_DRY_RUN) c.flags |= PURGE_FILES_DRY_RUN;
+    if (!spill && !(c.paths = pathset_create(a, n))) return EXIT_FAILURE;
+    if (c.paths)
+    {
+      for (i = 0; i < n; ++i) free(a[i]);
+      sync_job_free(&job);
+      memset(&job, 0, sizeof(job));
+      n = 0;
+    }
+    if (spill) { free(c.results); c.results = NULL; }
+    c.spill = spill;
+    for (j = 0; j < m; ++j)
+    {
+      if (options[3].is_present) { if (m > 1) printf(STR_DELETE_FORMAT, j + 1, q[j]); else puts(STR_DELETE_HEADING); }
+      else if (m > 1) printf(STR_PURGE_FORMAT, j + 1, q[j]); else puts(STR_PURGE);
+      if (q[j][(c.offset = strlen(q[j])) - 1] != JB_PATH_SEPARATOR) ++c.offset;
+      if (spill && spill_rewind(spill)) return EXIT_FAILURE;
+      if (!(task = (struct purge_task *)malloc(sizeof(struct purge_task)))) { perror("malloc"); return EXIT_FAILURE; }
+      memcpy(task->src, p, strlen(p) + 1);
+      memcpy(task->dst, q[j], strlen(q[j]) + 1);
+      if (c.paths) pathset_start(&task->cursor, c.paths);
+      tune_phase(TUNE_METADATA);
+      if (!c.results) purge_directory(&c, task, -1);
+      else { work_tree(purge_directory, &c, task); purge_output(&c); }
+    }
+    if (c.limited) puts(STR_LIMITED);
+    if (c.paths) pathset_free(c.paths);
+    free(c.results);
   }
 
 #ifndef _WIN32
@@ -189,37 +990,229 @@ int main(int argc, char * argv[])
 #endif
 
   /* All done. */
+  work_stop();
+  if (journal && journal_close(journal)) return EXIT_FAILURE;
+  if (manifest && manifest_close(manifest)) return EXIT_FAILURE;
+  if (dir_index && manifest_close(dir_index)) return EXIT_FAILURE;
+  if (c.cache && dircache_close(c.cache)) return EXIT_FAILURE;
+  if (spill) spill_close(spill);
   for (i = 0; i < n; ++i) free(a[i]);
-  free(a);
+  sync_job_free(&job);
   return EXIT_SUCCESS;
 }
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
- * Process (i.e., sync) a given file.
- *   path:  relative pathname of file
- *   src:  source directory pathname
- *   dst:  destination directory pathname
- *   flags:  bitwise-OR combination of process_file flags (PROCESS_FILE_VERBOSE/PROCESS_FILE_DRY_RUN)
+ * Process (i.e., sync) the files of a job.  First, each source file is compared to its corresponding destination files (unless
+ * this was already done, by the run that wrote the plan being applied).  Then the results are reported (in order).  Finally,
+ * each source file is copied to every destination that needs it.  (The files are shared among the worker threads, and if
+ * the job's copies are scheduled by device, each device has its own limit on the number of copies in flight.)  If a
+ * manifest is being written, the files that were synced are then added to it.
+ *   job:  files to sync
+ */
+void process_files(struct sync_job * job)
+{
+  int i, j, n;
+  const unsigned char * k;
+  const char * p;
+
+  if (!(job->flags & PROCESS_FILES_PLANNED))
+  {
+    tune_phase((policy->needs & COMPARE_NEEDS_CONTENTS) ? TUNE_BANDWIDTH : TUNE_METADATA);
+    work_run(compare_file, job, job->path_count);
+  }
+  for (i = 0; i < job->path_count; ++i)
+  {
+    if (process_file(job, i)) { job->copies[job->copy_count++] = i; continue; }
+
+    /* There is nothing to copy, so (unless an error occurred) the file is already synced. */
+    if (!journal || (job->flags & PROCESS_FILES_DRY_RUN)) continue;
+    for (j = 0; j < job->dst_count && job->results[i * job->dst_count + j] != COMPARE_FILES_ERROR; ++j);
+    if (j == job->dst_count) journal_complete(journal, job->paths[i]);
+  }
+  if (!(job->flags & PROCESS_FILES_DRY_RUN))
+  {
+    /* If copies are scheduled by device, queue each file by the devices it touches: that of the
+     * source file, and that of each destination file to which it is to be copied (see compare_file).
+     */
+    if (job->dst_devices)
+    {
+      for (i = 0; i < job->copy_count; ++i)
+      {
+        n = job->copies[i];
+        k = &job->devices[n * (job->dst_count + 1)];
+        job->masks[i] = 1ull << k[0];
+        for (j = 0; j < job->dst_count; ++j)
+        {
+          if (!process_result((enum compare_files_result)job->results[n * job->dst_count + j], 0, &p)) continue;
+          job->masks[i] |= 1ull << k[j + 1];
+        }
+      }
+      device_queue(job->masks, job->copy_count);
+    }
+    tune_phase(TUNE_BANDWIDTH);
+    work_run(sync_file, job, job->copy_count);
+  }
+  if (manifest) manifest_files(job);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Process the files of a shared work queue, one batch at a time (each as a job of its own), until there are none left.
+ * (The number of files compared and copied, etc., is accumulated in this process's statistics in the work queue.)
+ *   share:  work queue (shared with the coordinator and other workers)
+ *   job:  source and destination directories, etc. (but no files)
+ */
+void process_shared(struct share * share, struct sync_job * job)
+{
+  struct share_stats * stats = share_stats(share, -1);
+  struct sync_job batch;
+  char * paths[SHARE_BATCH_SIZE];
+  int i, j, n;
+
+  while ((n = share_claim(share, &j)) > 0)
+  {
+    /* The pathnames of the batch are in shared memory, so they need not be copied (or freed).  (Any sizes and times input
+     * are indexed by the coordinator's job, not the batch, and the workers do not have them at all, so they are not used.)
+     */
+    batch = *job;
+    batch.known = NULL;
+    for (i = 0; i < n; ++i) paths[i] = (char *)share_path(share, j + i);
+    if (!sync_job_allocate(&batch, paths, job->dst_count, n))
+    {
+      process_files(&batch);
+      fflush(stdout);
+
+      /* Accumulate the statistics for the batch. */
+      stats->copies += batch.copy_count;
+      for (i = 0; i < batch.copy_count; ++i) stats->bytes += batch.sizes[batch.copies[i]];
+      for (i = 0; i < n * batch.dst_count; ++i) if (batch.results[i] == COMPARE_FILES_ERROR) ++stats->errors;
+    }
+    else stats->errors += n;
+    stats->files += n;
+    batch.paths = NULL;
+    sync_job_free(&batch);
+  }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Process the files of a spill, one batch at a time (each as a job of its own), in sorted order.
+ *   spill:  files spilled to disk
+ *   job:  source and destination directories, etc. (but no files)
+ *   budget:  memory allowed for each batch (in bytes; see sync_job_memory)
+ * Return Value:  Nonzero if any file could not be synced (or the spill could not be read back); otherwise, zero.
+ */
+int process_spilled(struct spill * spill, struct sync_job * job, double budget)
+{
+  struct sync_job batch;
+  char s[JB_PATH_MAX_LENGTH], ** paths = NULL;
+  size_t z, * zs = NULL;
+  time_t t, * ts = NULL;
+  long x, * ns = NULL;
+  int i, n, r, e = 0, size = 0;
+  double spent;
+
+  if (spill_rewind(spill)) return -1;
+  do
+  {
+    /* Get as many files as fit in the memory allowed (but at least one), allocating memory for more as needed. */
+    for (n = 0, spent = 0; (!n || spent < budget) && (r = spill_get(spill, s, &z, &t, &x)) > 0; ++n)
+    {
+      if (n == size)
+      {
+        size = size ? 2 * size : 256;
+        paths = (char **)realloc(paths, size * sizeof(char *));
+        zs = (size_t *)realloc(zs, size * sizeof(size_t));
+        ts = (time_t *)realloc(ts, size * sizeof(time_t));
+        ns = (long *)realloc(ns, size * sizeof(long));
+      }
+      paths[n] = (char *)malloc(i = strlen(s) + 1);
+      memcpy(paths[n], s, i);
+      zs[n] = z; ts[n] = t; ns[n] = x;
+      spent += sync_job_memory(s, job->dst_count);
+    }
+    if (!n) break;
+
+    /* Sync the batch. */
+    batch = *job;
+    if (sync_job_allocate(&batch, paths, job->dst_count, n)) e = 1;
+    else
+    {
+      sync_job_known(&batch, zs, ts, ns);
+      process_files(&batch);
+      for (i = 0; i < n * batch.dst_count; ++i) if (batch.results[i] == COMPARE_FILES_ERROR) e = 1;
+    }
+    for (i = 0; i < n; ++i) free(paths[i]);
+    batch.paths = NULL;
+    sync_job_free(&batch);
+  } while (r > 0);
+  free(paths); free(zs); free(ts); free(ns);
+  return e || r < 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Report the statistics of each worker process (including the coordinator) of a shared work queue, and their totals.
+ *   share:  work queue
+ *   count:  number of workers
+ */
+void report_workers(struct share * share, int count)
+{
+  struct share_stats * stats, total = { 0 };
+  int i;
+
+  puts(STR_WORKERS_HEADING);
+  for (i = 0; i < count; ++i)
+  {
+    stats = share_stats(share, i);
+    printf(STR_WORKERS_FORMAT, i + 1, stats->pid, stats->files, stats->copies, stats->bytes, stats->errors,
+           (stats->done > 0) ? "" : STR_UNFINISHED);
+    total.files += stats->files;
+    total.copies += stats->copies;
+    total.bytes += stats->bytes;
+    total.errors += stats->errors;
+  }
+  printf(STR_WORKERS_TOTAL, total.files, total.copies, total.bytes, total.errors);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Process (i.e., report the results of comparing) a given file.
+ *   job:  files to sync
+ *   index:  index of file in job
+ * Return Value:  Nonzero if the source file needs to be copied to at least one destination; otherwise, zero.
  */
-void process_file(const char * path, const char * src, const char * dst, int flags)
+int process_file(struct sync_job * job, int index)
 {
   static const int j = MAX_LINE_LENGTH - 18, k = MAX_LINE_LENGTH - 26;
 
-  char r[JB_PATH_MAX_LENGTH], s[JB_PATH_MAX_LENGTH];
-  size_t n;
-  time_t t;
-  enum compare_files_result result;
-  const char * p = NULL;
-  int b, v = flags & PROCESS_FILE_VERBOSE;
+  char q[JB_PATH_MAX_LENGTH + 4];
+  const char * p, * path = job->paths[index];
+  int i, m, v = job->flags & PROCESS_FILES_VERBOSE;
+
+  for (i = m = 0; i < job->dst_count; ++i)
+  {
+    /* Build the appropriate message and decide whether or not to copy
+     * the source to the destination, based on the comparison result.
+     */
+    if (process_result((enum compare_files_result)job->results[index * job->dst_count + i], v, &p)) ++m;
 
-  /* Compare the source and destination files, by absolute pathnames. */
-  path_build(r, src, path);
-  path_build(s, dst, path);
-  result = compare_files(r, s, &n, &t);
+    /* If appropriate, output the message (prefixed by the DEST number, if there is more than one DEST). */
+    if (!p) continue;
+    if (job->dst_count > 1) sprintf(q, "%d:%s", i + 1, path);
+    path_output((job->dst_count > 1) ? q : path, v ? k : j); puts(p);
+  }
+  return m;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Decide what to do about the result of comparing a source file to a destination file.
+ *   result:  result of comparison
+ *   verbose:  nonzero if a message should be output for any result (not just those for which the file is copied)
+ *   message_ptr:  receives message to output (or NULL, if none)
+ * Return Value:  Nonzero if the source file should be copied to the destination; otherwise, zero.
+ */
+int process_result(enum compare_files_result result, int verbose, const char ** message_ptr)
+{
+  const char * p = NULL;
+  int b = 0, v = verbose;
 
-  /* Build the appropriate message and decide whether or not to copy
-   * the source to the destination, based on the comparison result.
-   */
   switch (result)
   {
     case COMPARE_FILES_ERROR:        if (v) p = STR_ERROR;                b = 0; break;
@@ -231,211 +1224,1769 @@ void process_file(const char * path, const char * src, const char * dst, int fla
     case COMPARE_FILES_DST_NEWER:    if (v) p = STR_DST_NEWER;            b = 0; break;
     case COMPARE_FILES_SRC_LARGER:   p = v ? STR_SRC_LARGER : STR_LARGER; b = 1; break;
     case COMPARE_FILES_SRC_NEWER:    p = v ? STR_SRC_NEWER : STR_NEWER;   b = 1; break;
+    case COMPARE_FILES_DST_PARTIAL:  p = v ? STR_DST_PARTIAL : STR_PARTIAL; b = 1; break;
+    case COMPARE_FILES_DIFFERENT:    p = v ? STR_DIFFERENT_CONTENT : STR_DIFFERENT; b = 1; break;
+    case COMPARE_FILES_SAME_SIZE:    if (v) p = STR_SAME_SIZE;            b = 0; break;
+    case COMPARE_FILES_SIZE_DIFFERS: p = v ? STR_DIFFERENT_SIZE : STR_SIZE_DIFFERS; b = 1; break;
+    case COMPARE_FILES_SAME_CONTENTS: if (v) p = STR_SAME_CONTENTS;       b = 0; break;
+    case COMPARE_FILES_CONTENTS_DIFFER: p = v ? STR_DIFFERENT_CONTENT : STR_CONTENTS_DIFFER; b = 1; break;
+    case COMPARE_FILES_DST_REPLACE:  p = v ? STR_DST_REPLACE : STR_REPLACE; b = 1; break;
+    case COMPARE_FILES_DST_EXISTS:   if (v) p = STR_DST_EXISTS;           b = 0; break;
+    case COMPARE_FILES_UNCHANGED:    if (v) p = STR_UNCHANGED;            b = 0; break;
   }
-
-  /* If appropriate, output the message and/or copy the source to the destination. */
-  if (p) { path_output(path, v ? k : j); puts(p); }
-  if (b && !(flags & PROCESS_FILE_DRY_RUN)) copy_file(r, s, n, t);
+  *message_ptr = p;
+  return b;
 }
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
- * Compare two files.
- *   src:  absolute pathname of source file
- *   dst:  absolute pathname of destination file
- *   size_ptr:  receives size (in bytes) of source file
- *   mtime_ptr:  receives modification time of source file
- * Return Value:  Result of comparison.
+ * Compare a file of a job to its corresponding destination files (as a work_function).
+ *   context:  files to sync
+ *   index:  index of file in job
  */
-enum compare_files_result compare_files(const char * src, const char * dst, size_t * size_ptr, time_t * mtime_ptr)
+void compare_file(void * context, int index)
 {
-  struct stat src_stat, dst_stat;
+  struct sync_job * job = (struct sync_job *)context;
+  char r[JB_PATH_MAX_LENGTH], s[MAX_DEST_COUNT][JB_PATH_MAX_LENGTH];
+  enum compare_files_result results[MAX_DEST_COUNT];
+  const struct journal_entry * e;
+  unsigned char * d = NULL;
+  int i, k, c;
+  size_t z = job->sizes[index];
+  time_t t = job->mtimes[index];
+  long n = job->nsecs[index];
+
+  /* If the file is in a directory whose summary matches the index, it is already known to be synced (see index_files). */
+  if (job->known && job->known[index] > 1) return;
+
+  /* If copies are scheduled by device, each destination file is on the same device as its destination directory (and the
+   * source file, as its), unless (or until) stat'ing it says otherwise.
+   */
+  if (job->dst_devices)
+  {
+    d = &job->devices[index * (job->dst_count + 1)];
+    d[0] = job->dst_devices[job->dst_count];
+    memcpy(d + 1, job->dst_devices, job->dst_count);
+  }
+
+  /* If the size and time of the source file were input, they are trusted (so that it need not be stat'ed), unless it is
+   * to be spot-checked.
+   */
+  k = job->known && job->known[index];
+  c = k && spot_check && !(index % spot_check);
+
+  /* Compare the source file to each destination file, by absolute pathnames. */
+  pressure_check();
+  tune_check();
+  path_build(r, job->src, job->paths[index]);
+  for (i = 0; i < job->dst_count; ++i) path_build(s[i], job->dst[i], job->paths[index]);
+  compare_files(r, s, job->dst_count, job->windows, job->epochs, results, &job->sizes[index], &job->mtimes[index],
+                &job->nsecs[index], d, k && !c);
+
+  /* If a spot check finds that the source file is not as input, say so.  (It is compared as it actually is.) */
+  if (c && results[0] > COMPARE_FILES_SRC_NOT_FILE &&
+      (job->sizes[index] != z || compare_times(job->mtimes[index], job->nsecs[index], t, n, 0)))
+  {
+    fprintf(stderr, STR_SPOT_CHECK_FORMAT, job->paths[index], (double)z, (long long)t, n);
+  }
 
-  /* If the source file does not exist, return that result.  (If an error occurred, return that too.) */
-  if (stat(src, &src_stat))
+  /* If copying the file was interrupted (and the source file has not changed since), the destination files it was
+   * being copied to are incomplete, however new they may seem.  (They need to be copied, if only to finish them.)
+   */
+  if (journal && (e = journal_find(journal, job->paths[index])) && !e->complete &&
+      e->size == job->sizes[index] && e->mtime == job->mtimes[index])
   {
-    if (errno == ENOENT) return COMPARE_FILES_SRC_NO_EXIST;
-    perror("stat"); return COMPARE_FILES_ERROR;
+    for (i = 0; i < job->dst_count; ++i)
+      if ((e->dsts >> i & 1) && results[i] >= COMPARE_FILES_SAME_AGE) results[i] = COMPARE_FILES_DST_PARTIAL;
   }
+  for (i = 0; i < job->dst_count; ++i) job->results[index * job->dst_count + i] = (unsigned char)results[i];
+}
 
-  /* The source file exists.  If it is not a regular file, return that result. */
-  if ((src_stat.st_mode & S_IFMT) != S_IFREG) return COMPARE_FILES_SRC_NOT_FILE;
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copy a file of a job to each destination that needs it (as a work_function).
+ *   context:  files to sync
+ *   index:  index into the job's list of files to copy
+ */
+void sync_file(void * context, int index)
+{
+  struct sync_job * job = (struct sync_job *)context;
+  char r[JB_PATH_MAX_LENGTH], s[MAX_DEST_COUNT][JB_PATH_MAX_LENGTH];
+  const char * p, * d[MAX_DEST_COUNT];
+  int i, m, n;
+  unsigned int b = 0;
+  size_t k = 0;
+  const struct journal_entry * e;
+  struct stat st;
 
-  /* The source file exists and is a regular file.  Retrieve its total size (in bytes) and time of last modification. */
-  *size_ptr = src_stat.st_size;
-  *mtime_ptr = src_stat.st_mtime;
+  /* If copies are scheduled by device, the file to copy is the next one whose devices can take it (see device_claim). */
+  pressure_check();
+  tune_check();
+  n = job->copies[index = device_claim(index)];
 
-  /* If the destination file does not exist, return that result.  (If an error occurred, return that too.) */
-  if (stat(dst, &dst_stat))
+  /* Build the absolute pathnames of the source file and of each destination file that needs it. */
+  path_build(r, job->src, job->paths[n]);
+  for (i = m = 0; i < job->dst_count; ++i)
   {
-    if (errno == ENOENT) return COMPARE_FILES_DST_NO_EXIST;
-    perror("stat"); return COMPARE_FILES_ERROR;
+    if (!process_result((enum compare_files_result)job->results[n * job->dst_count + i], 0, &p)) continue;
+    path_build(s[i], job->dst[i], job->paths[n]);
+    d[m++] = s[i];
+    b |= 1u << i;
   }
 
-  /* The destination file exists.  If it is not a regular file, return that result. */
-  if ((dst_stat.st_mode & S_IFMT) != S_IFREG) return COMPARE_FILES_DST_NOT_FILE;
+  /* If copying the file (to these same destinations) was interrupted, and neither the source file nor any destination
+   * file has changed since (as far as can be told), finish the copy from where it left off, as recorded in the journal.
+   */
+  if (journal && (e = journal_find(journal, job->paths[n])) && !e->complete &&
+      e->size == job->sizes[n] && e->mtime == job->mtimes[n] && !(b & ~e->dsts))
+  {
+    for (i = 0; i < m && !stat(d[i], &st) && (size_t)st.st_size >= e->offset && (size_t)st.st_size <= e->size; ++i);
+    if (i == m) k = e->offset;
+  }
 
-  /* The destination file exists and is a regular file.  Compare the two files' timestamps.
-   * If they are the same age or the destination file is newer, return the respective result.
+  /* Copy the source to each destination that needs it (reading the source only once, and hashing it along the way, if
+   * a manifest is being written).  If that succeeded (for every destination), and this sync is being journaled, record
+   * that fact; likewise, the hash is then known.
    */
-  if (src_stat.st_mtime == dst_stat.st_mtime) return COMPARE_FILES_SAME_AGE;
-  if (src_stat.st_mtime < dst_stat.st_mtime) return COMPARE_FILES_DST_NEWER;
+  i = verify ? COPY_VERIFY_ATTEMPTS : -1;
+  if (copy_file(r, d, m, job->sizes[n], job->mtimes[n], job->nsecs[n], k, journal ? job->paths[n] : NULL, b, i,
+                job->hashes ? &job->hashes[n * SHA256_SIZE] : NULL) == m)
+  {
+    if (journal) journal_complete(journal, job->paths[n]);
+    if (job->hashes) job->hashed[n] = HASH_KNOWN;
+  }
 
-  /* The source file is newer than the destination file.  Return the result based on how their sizes compare. */
-  return (src_stat.st_size > dst_stat.st_size) ? COMPARE_FILES_SRC_LARGER : COMPARE_FILES_SRC_NEWER;
+  /* Otherwise, the copy failed (to one destination or more), so count it as an error for each of them. */
+  else for (i = 0; i < job->dst_count; ++i) if (b >> i & 1) job->results[n * job->dst_count + i] = COMPARE_FILES_ERROR;
+  device_done(index, (double)(job->sizes[n] - k));
 }
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
- * Copy a file.
- * (While it might be tempting to have the shell/OS execute this command (say,
+ * Add each file of a job that was synced (i.e., that every destination either already had, or now has) to the manifest.
+ * The hashes of files that were copied were computed while copying them.  Those of files that were already the same age
+ * at every destination are taken from the manifest as loaded, if they are there; otherwise, they are computed now.
+ *   job:  files to sync
+ */
+void manifest_files(struct sync_job * job)
+{
+  const unsigned char * h;
+  const char * p;
+  int i, j, m, r;
+
+  for (i = m = 0; i < job->path_count; ++i)
+  {
+    /* If any destination lacks the file (because it is newer there, or could not be copied, etc.), leave it out. */
+    for (j = 0; j < job->dst_count; ++j)
+    {
+      r = job->results[i * job->dst_count + j];
+      if (r == COMPARE_FILES_SAME_AGE || r == COMPARE_FILES_SAME_SIZE || r == COMPARE_FILES_SAME_CONTENTS ||
+          r == COMPARE_FILES_UNCHANGED) continue;
+      if (!process_result((enum compare_files_result)r, 0, &p) || job->hashed[i] != HASH_KNOWN) break;
+    }
+    if (j < job->dst_count) job->hashed[i] = HASH_UNKNOWN;
+    else if (job->hashed[i] == HASH_KNOWN) continue;
+    else if (!(h = manifest_find(manifest, job->paths[i]))) { job->hashed[i] = HASH_NEEDED; ++m; }
+    else { memcpy(&job->hashes[i * SHA256_SIZE], h, SHA256_SIZE); job->hashed[i] = HASH_KNOWN; }
+  }
+
+  /* Hash the source files whose hashes are still needed (sharing them among the worker threads). */
+  if (m) { tune_phase(TUNE_BANDWIDTH); work_run(hash_file, job, job->path_count); }
+  for (i = 0; i < job->path_count; ++i)
+  {
+    if (job->hashed[i] == HASH_KNOWN && manifest_put(manifest, job->paths[i], &job->hashes[i * SHA256_SIZE])) break;
+  }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compute the hash of a source file of a job, if it is needed (as a work_function).
+ *   context:  files to sync
+ *   index:  index of file in job
+ */
+void hash_file(void * context, int index)
+{
+  struct sync_job * job = (struct sync_job *)context;
+  char r[JB_PATH_MAX_LENGTH];
+  struct sha256 h;
+  void * p;
+  FILE * f;
+  size_t n;
+
+  if (job->hashed[index] != HASH_NEEDED) return;
+  job->hashed[index] = HASH_UNKNOWN;
+  pressure_check();
+  tune_check();
+
+  /* Open the source file (which counts against the I/O operation limit, as does each block read). */
+  path_build(r, job->src, job->paths[index]);
+  if (!(p = malloc(COPY_BLOCK_SIZE))) { perror("malloc"); return; }
+  limit_take(&operations, 1);
+  if (!(f = fopen(r, "rb"))) { perror("fopen"); free(p); return; }
+
+  /* Read the file one block at a time, adding each to the hash. */
+  sha256_init(&h);
+  for (;;)
+  {
+    limit_take(&operations, 1);
+    if (!(n = fread(p, 1, COPY_BLOCK_SIZE, f))) break;
+    sha256_update(&h, p, n);
+  }
+  if (ferror(f)) perror("fread");
+  else { sha256_final(&h, &job->hashes[index * SHA256_SIZE]); job->hashed[index] = HASH_KNOWN; }
+  fclose(f);
+  free(p);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Summarize the files of a job by directory, as a Merkle tree: the summary of a directory is the hash of the name, size,
+ * and time of each file in it, and of the name and summary of each subdirectory.  Before the files are compared, those in
+ * directories whose summaries match the index (as of the last sync) are marked as synced already, so that only directories
+ * that have changed are compared.  (This requires the sizes and times of the files to have been input, since stat'ing
+ * them to find out would defeat the purpose.)  After the files are synced, the summary of each directory whose files were
+ * all synced (to every destination) is put in the index, for next time.  (Each summary begins with the comparison policy
+ * and the destination directories, so that an index kept for other destinations, or another policy, matches nothing.)
+ *   job:  files to sync
+ *   synced:  nonzero if the files have been synced (so that the index is to be updated); otherwise, zero
+ */
+void index_files(struct sync_job * job, int synced)
+{
+  struct index_level v[JB_PATH_MAX_LENGTH / 2 + 1];
+  struct sha256 k;
+  char s[JB_PATH_MAX_LENGTH], b[JB_PATH_MAX_LENGTH + 64];
+  const char * p, * q;
+  int i, n, d = 0, * a;
+
+  /* Sort the files by pathname (so that the files in each directory, including those in its subdirectories, are together). */
+  if (!(a = (int *)malloc((job->path_count + 1) * sizeof(int)))) { perror("malloc"); return; }
+  for (i = 0; i < job->path_count; ++i) a[i] = i;
+  sort_paths = job->paths;
+  qsort(a, job->path_count, sizeof(int), compare_paths);
+
+  /* Begin the summary of every directory with the comparison policy and the destination directories (one per line). */
+  sha256_init(&k);
+  sha256_update(&k, policy->name, strlen(policy->name) + 1);
+  for (i = 0; i < job->dst_count; ++i) { sha256_update(&k, job->dst[i], strlen(job->dst[i])); sha256_update(&k, "\n", 1); }
+
+  /* Beginning with the root, summarize each directory as its files are reached, and finish it once they are all added. */
+  v[0].sha = k;
+  v[0].length = v[0].start = 0;
+  v[0].complete = 1;
+  for (i = 0; i < job->path_count; ++i)
+  {
+    /* Finish each directory (the deepest first) that does not contain the file. */
+    p = job->paths[n = a[i]];
+    for (; d && strncmp(p, s, v[d].length); --d) index_directory(job, &v[d], s, a, i, synced);
+
+    /* Begin each directory of the file that has not been begun. */
+    while (q = strchr(p + v[d].length, JB_PATH_SEPARATOR))
+    {
+      v[++d].sha = k;
+      memcpy(s, p, v[d].length = (int)(q - p) + 1);
+      v[d].start = i;
+      v[d].complete = 1;
+    }
+
+    /* Add the file to its directory.  (If it was not synced, or its size and time were not input, the directory cannot be
+     * summarized, since its summary would not be of what is in the destination.)
+     */
+    sprintf(b, "%s\t%.0f\t%lld.%09ld\n", p + v[d].length, (double)job->sizes[n], (long long)job->mtimes[n], job->nsecs[n]);
+    sha256_update(&v[d].sha, b, strlen(b));
+    if (synced ? !synced_file(job, n) : !job->known[n]) v[d].complete = 0;
+  }
+  for (; d >= 0; --d) index_directory(job, &v[d], s, a, i, synced);
+  free(a);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Finish summarizing a directory (see index_files): check its summary against the index (or put it there), and add it to
+ * the summary of its parent directory.
+ *   job:  files to sync
+ *   level:  directory being summarized (in an array of directories, preceded by its parent)
+ *   path:  relative pathname of the directory (followed by its trailing separator; only the length of the directory counts)
+ *   sorted:  indices of the files of the job, sorted by pathname
+ *   end:  index (into sorted) after the last file in the directory
+ *   synced:  nonzero if the files have been synced; otherwise, zero
+ */
+void index_directory(struct sync_job * job, struct index_level * level, const char * path, const int * sorted, int end,
+                     int synced)
+{
+  unsigned char h[SHA256_SIZE];
+  char s[JB_PATH_MAX_LENGTH];
+  const unsigned char * e;
+  int i, j, n = level->length;
+
+  /* The root directory is "." in the index; any other is its relative pathname (without its trailing separator). */
+  sha256_final(&level->sha, h);
+  if (n) { memcpy(s, path, --n); s[n] = '\0'; } else strcpy(s, ".");
+
+  /* If every file in the directory has been synced, put its summary in the index.  Or, if its summary matches that in
+   * the index, mark each file in it as synced already (to every destination).
+   */
+  if (level->complete && synced) manifest_put(dir_index, s, h);
+  else if (level->complete && (e = manifest_find(dir_index, s)) && !memcmp(e, h, SHA256_SIZE))
+  {
+    for (i = level->start; i < end; ++i)
+    {
+      job->known[n = sorted[i]] = 2;
+      for (j = 0; j < job->dst_count; ++j) job->results[n * job->dst_count + j] = COMPARE_FILES_UNCHANGED;
+    }
+  }
+
+  /* Add the name and summary of the directory to the summary of its parent (unless it is the root). */
+  if (!level->length) return;
+  i = level->complete;
+  --level;
+  sha256_update(&level->sha, s + level->length, strlen(s + level->length));
+  sha256_update(&level->sha, "/", 1);
+  sha256_update(&level->sha, h, SHA256_SIZE);
+  if (!i) level->complete = 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Determine whether a file of a job was synced: that is, whether every destination either already had it or now has it.
+ *   job:  files to sync
+ *   index:  index of file in job
+ * Return Value:  Nonzero if the file was synced; otherwise, zero.
+ */
+int synced_file(struct sync_job * job, int index)
+{
+  const char * p;
+  int j, r;
+
+  for (j = 0; j < job->dst_count; ++j)
+  {
+    r = job->results[index * job->dst_count + j];
+    if (r == COMPARE_FILES_SAME_AGE || r == COMPARE_FILES_SAME_SIZE || r == COMPARE_FILES_SAME_CONTENTS ||
+        r == COMPARE_FILES_UNCHANGED) continue;
+    if (!process_result((enum compare_files_result)r, 0, &p) || r == COMPARE_FILES_ERROR) return 0;
+  }
+  return 1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Allocate memory for the files of a job.  (The sizes are computed as size_t, since the number of files times the number of
+ * destinations may not fit in an int.)
+ *   job:  files to sync
+ *   paths:  relative pathnames of files
+ *   dst_count:  number of destination directories
+ *   path_count:  number of pathnames in paths
+ * Return Value:  Zero on success; otherwise (if memory could not be allocated, in which case what was allocated should
+ *                still be freed with sync_job_free), nonzero.
+ */
+int sync_job_allocate(struct sync_job * job, char ** paths, int dst_count, int path_count)
+{
+  size_t n = (size_t)path_count;
+
+  job->paths = paths;
+  job->path_count = path_count;
+  job->dst_count = dst_count;
+  job->sizes = (size_t *)calloc(n + 1, sizeof(size_t));
+  job->mtimes = (time_t *)calloc(n + 1, sizeof(time_t));
+  job->nsecs = (long *)calloc(n + 1, sizeof(long));
+  job->results = (unsigned char *)calloc(n * dst_count + 1, 1);
+  job->copies = (int *)malloc((n + 1) * sizeof(int));
+  job->devices = (unsigned char *)calloc(n * (dst_count + 1) + 1, 1);
+  job->masks = (unsigned long long *)malloc((n + 1) * sizeof(unsigned long long));
+  job->hashes = manifest ? (unsigned char *)malloc(n * SHA256_SIZE + 1) : NULL;
+  job->hashed = manifest ? (char *)calloc(n + 1, 1) : NULL;
+  if (!job->sizes || !job->mtimes || !job->nsecs || !job->results || !job->copies || !job->devices || !job->masks ||
+      (manifest && (!job->hashes || !job->hashed)))
+  {
+    perror("malloc"); return -1;
+  }
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Note the sizes and times input of the files of a job, which need not be stat'ed in the source directory (see compare_file).
+ *   job:  files to sync (allocated by sync_job_allocate)
+ *   sizes:  size (in bytes) of each file
+ *   mtimes:  modification time of each file
+ *   nsecs:  nanoseconds part of the modification time of each file (or, if its size and time were not input, negative)
+ */
+void sync_job_known(struct sync_job * job, const size_t * sizes, const time_t * mtimes, const long * nsecs)
+{
+  int i;
+
+  for (i = 0; i < job->path_count && nsecs[i] < 0; ++i);
+  if (i < job->path_count) job->known = (char *)calloc(job->path_count + 1, 1);
+  for (; i < job->path_count; ++i)
+  {
+    if (nsecs[i] < 0) continue;
+    job->sizes[i] = sizes[i]; job->mtimes[i] = mtimes[i]; job->nsecs[i] = nsecs[i]; job->known[i] = 1;
+  }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Estimate the memory that a file takes in a job (for its pathname, and its items in the arrays of the job), as well as
+ * while it is being input (see --memory).
+ *   path:  relative pathname of file
+ *   dst_count:  number of destination directories
+ * Return Value:  Number of bytes (roughly).
+ */
+size_t sync_job_memory(const char * path, int dst_count)
+{
+  return strlen(path) + 1 + sizeof(char *) + 2 * (sizeof(size_t) + sizeof(time_t) + sizeof(long)) + sizeof(int) +
+         sizeof(unsigned long long) + 2 * dst_count + 2 + (manifest ? SHA256_SIZE + 1 : 0);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Free the memory allocated for the files of a job.  (The pathnames themselves are not freed.)
+ *   job:  files to sync
+ */
+void sync_job_free(struct sync_job * job)
+{
+  free(job->paths);
+  free(job->sizes);
+  free(job->mtimes);
+  free(job->nsecs);
+  free(job->results);
+  free(job->copies);
+  free(job->devices);
+  free(job->masks);
+  free(job->hashes);
+  free(job->hashed);
+  free(job->known);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Write the plan of a job (i.e., the results of comparing its files) to a file, so that it can be applied later.
+ *   path:  pathname of plan file
+ *   job:  files to sync
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int write_plan(const char * path, struct sync_job * job)
+{
+  struct plan * plan;
+  int i, n, * a;
+
+  /* Sort the files by pathname. */
+  if (!(a = (int *)malloc(job->path_count * sizeof(int)))) { perror("malloc"); return -1; }
+  for (i = 0; i < job->path_count; ++i) a[i] = i;
+  sort_paths = job->paths;
+  qsort(a, job->path_count, sizeof(int), compare_paths);
+
+  /* Write each file (in sorted order) to the plan. */
+  if (!(plan = plan_create(path, job->dst_count, job->path_count))) { free(a); return -1; }
+  for (i = 0; i < job->path_count; ++i)
+  {
+    n = a[i];
+    if (plan_put(plan, job->paths[n], &job->results[n * job->dst_count], job->sizes[n], job->mtimes[n])) break;
+  }
+  free(a);
+  if (i < job->path_count) { plan_close(plan); return -1; }
+  return plan_close(plan);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Scrub (i.e., check against a manifest) the files in one or more destination directories, by reading each file (from disk,
+ * rather than from cache) to compute its hash.  The files are shared among the worker threads, in order by pathname.  If
+ * the scrub is sliced, it resumes after the file at which the last slice stopped (recorded in a cursor file), and stops
+ * starting files once its time is up, recording where it stopped; a scrub that gets to the end removes the cursor file, so
+ * that the next one begins again at the start.
+ *   path:  pathname of manifest (the cursor file is the same, with ".cursor" appended)
+ *   dst:  destination directory pathnames
+ *   dst_count:  number of pathnames in dst
+ *   slice:  number of seconds for which to scrub (or, if zero, the whole manifest is scrubbed, and the cursor is ignored)
+ *   verbose:  nonzero if a message should be output for every file (not just those that did not match)
+ * Return Value:  Number of files that did not match the manifest (or, if the scrub could not be done at all, -1).
+ */
+int scrub_files(const char * path, char ** dst, int dst_count, double slice, int verbose)
+{
+  static const int k = MAX_LINE_LENGTH - 18;
+
+  struct scrub_job job = { 0 };
+  struct manifest * m;
+  struct stat st;
+  char s[JB_PATH_MAX_LENGTH], q[JB_PATH_MAX_LENGTH + 4], * c;
+  const char * p;
+  FILE * f;
+  int i, j, a, b, n = 0;
+  double x = 0;
+
+  if (!(m = manifest_open(path, 0))) return -1;
+  if (!(c = (char *)malloc(strlen(path) + 8))) { perror("malloc"); manifest_close(m); return -1; }
+  sprintf(c, "%s.cursor", path);
+  job.dst = dst;
+  job.dst_count = dst_count;
+  job.entries = m->entries;
+  job.entry_count = m->entry_count;
+  job.mtime = stat(path, &st) ? 0 : st.st_mtime;
+
+  /* If the scrub is sliced, skip the files up to (and including) the one at which the last slice stopped. */
+  if (slice > 0)
+  {
+    job.deadline = time(NULL) + (time_t)slice;
+    if ((f = fopen(c, "rb")) && fgets(s, JB_PATH_MAX_LENGTH, f) && (i = strlen(s)) && s[i - 1] == '\n')
+    {
+      s[i - 1] = '\0';
+      for (a = 0, b = job.entry_count; a < b; ) if (strcmp(job.entries[i = (a + b) / 2].path, s) > 0) b = i; else a = i + 1;
+      job.entries += a;
+      job.entry_count -= a;
+    }
+    if (f) fclose(f);
+  }
+
+  /* Scrub the files (or as many of them as there is time for). */
+  job.results = (unsigned char *)calloc((size_t)job.entry_count * dst_count + 1, 1);
+  job.lengths = (double *)calloc(job.entry_count + (size_t)1, sizeof(double));
+  if (!job.results || !job.lengths)
+  {
+    perror("calloc"); free(job.results); free(job.lengths); free(c); manifest_close(m); return -1;
+  }
+  tune_phase(TUNE_BANDWIDTH);
+  work_run(scrub_file, &job, job.entry_count);
+
+#ifndef _WIN32
+  /* Output an empty line before the heading, to improve readability.
+   * (On Windows, this would have been done already, by jb_command_parse.)
+   */
+  putchar('\n');
+#endif
+
+  /* Report the results (in order), up to the first file that was not scrubbed (since the next slice resumes there). */
+  puts(STR_TERSE_HEADING);
+  for (i = 0; i < job.entry_count; ++i)
+  {
+    for (j = 0; j < dst_count && job.results[i * dst_count + j] != SCRUB_FILE_SKIPPED; ++j);
+    if (j < dst_count) break;
+    for (j = 0; j < dst_count; ++j)
+    {
+      switch (job.results[i * dst_count + j])
+      {
+        case SCRUB_FILE_ERROR:    p = STR_ERROR;          ++n; break;
+        case SCRUB_FILE_NO_EXIST: p = STR_SCRUB_NO_EXIST; ++n; break;
+        case SCRUB_FILE_CORRUPT:  p = STR_SCRUB_CORRUPT;  ++n; break;
+        case SCRUB_FILE_CHANGED:  p = STR_SCRUB_CHANGED;       break;
+        default:                  p = verbose ? STR_SCRUB_OK : NULL;
+      }
+      if (!p) continue;
+      if (dst_count > 1) sprintf(q, "%d:%s", j + 1, job.entries[i].path);
+      path_output((dst_count > 1) ? q : job.entries[i].path, k); puts(p);
+    }
+    x += job.lengths[i];
+  }
+  printf(STR_SCRUB_FORMAT, i, x, n);
+
+  /* If the scrub is sliced, record where it stopped (or, if it got to the end, that the next one is to begin again). */
+  if (slice > 0 && i < job.entry_count && i)
+  {
+    if (!(f = fopen(c, "wb"))) perror(c);
+    else if ((fprintf(f, "%s\n", job.entries[i - 1].path) < 0) | fclose(f)) perror(c);
+    printf(STR_SCRUB_CURSOR_FORMAT, job.entries[i - 1].path);
+  }
+  else if (slice > 0 && i == job.entry_count)
+  {
+    if (remove(c) && errno != ENOENT) perror(c);
+    puts(STR_SCRUB_FINISHED);
+  }
+
+#ifndef _WIN32
+  /* Output an empty line before the command prompt, to improve readability.  (Windows does this automatically.) */
+  putchar('\n');
+#endif
+
+  free(job.results);
+  free(job.lengths);
+  free(c);
+  manifest_close(m);
+  return n;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Scrub a file of a job in each destination directory (as a work_function), unless its time is up.
+ *   context:  files to scrub
+ *   index:  index of file in job
+ */
+void scrub_file(void * context, int index)
+{
+  struct scrub_job * job = (struct scrub_job *)context;
+  const struct manifest_entry * e = &job->entries[index];
+  unsigned char * r = &job->results[index * job->dst_count], h[SHA256_SIZE];
+  char s[JB_PATH_MAX_LENGTH];
+  struct sha256 sha;
+  struct stat st;
+  void * p;
+  FILE * f;
+  size_t n;
+  int i;
+
+  if (job->deadline && time(NULL) >= job->deadline) return;
+  pressure_check();
+  tune_check();
+  if (!(p = malloc(SCRUB_BLOCK_SIZE))) { perror("malloc"); memset(r, SCRUB_FILE_ERROR, job->dst_count); return; }
+  for (i = 0; i < job->dst_count; ++i)
+  {
+    /* Open the file, and evict it from cache (so that reading it tests what is actually on disk), hinting that it will be
+     * read sequentially.  (Each file opened, and each block read, counts against the I/O operation limit.)
+     */
+    path_build(s, job->dst[i], e->path);
+    limit_take(&operations, 1);
+    if (!(f = fopen(s, "rb")))
+    {
+      if (errno == ENOENT) r[i] = SCRUB_FILE_NO_EXIST; else { perror(s); r[i] = SCRUB_FILE_ERROR; }
+      continue;
+    }
+    FILE_EVICT(f);
+    FILE_SEQUENTIAL(f);
+
+    /* Read the file in large blocks (as fast as the bandwidth limit allows), hashing each, and then evict it again. */
+    sha256_init(&sha);
+    for (;;)
+    {
+      limit_take(&operations, 1);
+      if (!(n = fread(p, 1, SCRUB_BLOCK_SIZE, f))) break;
+      limit_take(&bandwidth, (double)n);
+      sha256_update(&sha, p, n);
+      job->lengths[index] += n;
+    }
+    FILE_EVICT(f);
+
+    /* A file whose hash does not match is corrupt, unless it was modified after the manifest was written. */
+    if (ferror(f)) { perror("fread"); r[i] = SCRUB_FILE_ERROR; }
+    else if (sha256_final(&sha, h), !memcmp(h, e->hash, SHA256_SIZE)) r[i] = SCRUB_FILE_OK;
+    else r[i] = (stat(s, &st) || st.st_mtime <= job->mtime) ? SCRUB_FILE_CORRUPT : SCRUB_FILE_CHANGED;
+    fclose(f);
+  }
+  free(p);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Parse a rate (in bytes per second), optionally followed by a suffix (K, M, or G, for KiB, MiB, or GiB).
+ *   s:  rate (as specified on the command line)
+ * Return Value:  Rate (in bytes per second), or zero if s is not a valid rate.
+ */
+double parse_rate(const char * s)
+{
+  char * p;
+  double x = strtod(s, &p);
+
+  switch (*p)
+  {
+    case 'K': case 'k': x *= 0x400;      ++p; break;
+    case 'M': case 'm': x *= 0x100000;   ++p; break;
+    case 'G': case 'g': x *= 0x40000000; ++p; break;
+  }
+  return (*p || x <= 0) ? 0 : x;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Parse a duration (for --slice).
+ *   s:  number of seconds (or, with suffix m or h, minutes or hours)
+ * Return Value:  Number of seconds (or, if s is not valid, zero).
+ */
+double parse_duration(const char * s)
+{
+  char * p;
+  double x = strtod(s, &p);
+
+  switch (*p)
+  {
+    case 'M': case 'm': x *= 60;   ++p; break;
+    case 'H': case 'h': x *= 3600; ++p; break;
+  }
+  return (*p || x <= 0) ? 0 : x;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Parse a line of input: the relative pathname of a file, optionally followed by its size (in bytes) and time (in seconds
+ * since 1970, with or without a fraction), each after a tab.  (The last two fields are taken from the end of the line, so
+ * that a pathname may contain tabs itself.)
+ *   s:  line of input (trimmed), which is truncated to the pathname if the size and time follow it
+ *   size_ptr:  receives size of file (if given)
+ *   mtime_ptr:  receives modification time of file (if given)
+ *   nsec_ptr:  receives nanoseconds part of modification time of file (if given; otherwise, zero)
+ * Return Value:  Nonzero if the size and time were given; otherwise, zero (and the whole line is the pathname).
+ */
+int parse_input(char * s, size_t * size_ptr, time_t * mtime_ptr, long * nsec_ptr)
+{
+  char * p, * q, * r;
+  long long x, y;
+  long n = 0;
+  int i = 9;
+
+  /* Find the last two tabs, and parse the numbers after them. */
+  if (!(q = strrchr(s, '\t'))) return 0;
+  for (p = q; p > s && *--p != '\t';);
+  if (*p != '\t') return 0;
+  x = strtoll(p + 1, &r, 10);
+  if (r == p + 1 || r != q || x < 0) return 0;
+  y = strtoll(q + 1, &r, 10);
+  if (r == q + 1) return 0;
+  if (*r == '.') for (i = 0, ++r; *r >= '0' && *r <= '9'; ++r) if (i < 9) n = n * 10 + (*r - '0'), ++i;
+  if (*r) return 0;
+  for (; i < 9; ++i) n *= 10;
+
+  /* The pathname is what precedes them. */
+  *p = '\0';
+  *size_ptr = (size_t)x;
+  *mtime_ptr = (time_t)y;
+  *nsec_ptr = n;
+  return 1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare the pathnames of two files (by their indices, as the comparison function for qsort).
+ *   a:  pointer to index of first file
+ *   b:  pointer to index of second file
+ * Return Value:  Less than, equal to, or greater than zero, if the first pathname sorts before, with, or after the second.
+ */
+int compare_paths(const void * a, const void * b)
+{
+  return strcmp(sort_paths[*(const int *)a], sort_paths[*(const int *)b]);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare a source file to one or more destination files.
+ *   src:  absolute pathname of source file
+ *   dst:  absolute pathnames of destination files
+ *   dst_count:  number of pathnames in dst
+ *   windows:  tolerance (see compare_times) for the modification time of each destination file
+ *   epochs:  time before which the source file is assumed synced to each destination (or, if NULL, it is compared to all)
+ *   results:  receives result of comparison to each destination file (one per pathname in dst)
+ *   size_ptr:  receives size (in bytes) of source file (or, if known, is it)
+ *   mtime_ptr:  receives modification time of source file (or, if known, is it)
+ *   nsec_ptr:  receives nanoseconds part of modification time of source file (or zero, if unknown)
+ *   devices:  receives device (see device_find) of source file (unless known), followed by that of each destination file
+ *     that exists (or, if NULL, devices are not found)
+ *   known:  nonzero if the size and time of the source file are known already (so that it need not be stat'ed)
+ */
+void compare_files(const char * src, char dst[][JB_PATH_MAX_LENGTH], int dst_count, const long long * windows,
+                   const time_t * epochs, enum compare_files_result * results, size_t * size_ptr, time_t * mtime_ptr,
+                   long * nsec_ptr, unsigned char * devices, int known)
+{
+  struct stat src_stat, dst_stat;
+  enum compare_files_result result;
+  int i, n;
+
+  /* Every file that is stat'ed counts against the I/O operation limit. */
+  if (!known) limit_take(&operations, 1);
+
+  /* If the size and time of the source file are known, it is taken to be a regular file (as if it had been stat'ed). */
+  if (known)
+  {
+    memset(&src_stat, 0, sizeof(src_stat));
+    src_stat.st_mode = S_IFREG;
+    src_stat.st_size = *size_ptr;
+    src_stat.st_mtime = *mtime_ptr;
+#ifndef _WIN32
+    src_stat.st_mtim.tv_nsec = *nsec_ptr;
+#endif
+  }
+
+  /* Otherwise, if the source file does not exist, that is the result for every destination.  (If an error occurred, so is
+   * that.)
+   */
+  else if (stat(src, &src_stat))
+  {
+    if (errno == ENOENT) result = COMPARE_FILES_SRC_NO_EXIST;
+    else { perror("stat"); result = COMPARE_FILES_ERROR; }
+    for (i = 0; i < dst_count; ++i) results[i] = result;
+    return;
+  }
+
+  /* The source file exists.  If it is not a regular file, that is the result for every destination. */
+  if ((src_stat.st_mode & S_IFMT) != S_IFREG)
+  {
+    for (i = 0; i < dst_count; ++i) results[i] = COMPARE_FILES_SRC_NOT_FILE;
+    return;
+  }
+
+  /* The source file exists and is a regular file.  Retrieve its total size (in bytes) and time of last modification. */
+  *size_ptr = src_stat.st_size;
+  *mtime_ptr = src_stat.st_mtime;
+  *nsec_ptr = STAT_MTIME_NSEC(src_stat);
+  if (devices && !known) devices[0] = (unsigned char)device_find(src_stat.st_dev);
+
+  /* If the source file has not been modified since a destination was last synced in full, the destination file is assumed
+   * to be synced (without stat'ing it).
+   */
+  for (i = n = 0; i < dst_count; ++i) if (!epochs || *mtime_ptr >= epochs[i]) ++n;
+  if (n) limit_take(&operations, n);
+
+  /* Compare the source file to each other destination file. */
+  for (i = 0; i < dst_count; ++i)
+  {
+    if (epochs && *mtime_ptr < epochs[i]) { results[i] = COMPARE_FILES_UNCHANGED; continue; }
+    /* If the destination file does not exist, that is the result.  (If an error occurred, so is that.) */
+    if (stat(dst[i], &dst_stat))
+    {
+      if (errno == ENOENT) results[i] = COMPARE_FILES_DST_NO_EXIST;
+      else { perror("stat"); results[i] = COMPARE_FILES_ERROR; }
+    }
+
+    /* The destination file exists.  If it is not a regular file, that is the result. */
+    else if ((dst_stat.st_mode & S_IFMT) != S_IFREG) results[i] = COMPARE_FILES_DST_NOT_FILE;
+
+    /* The destination file exists and is a regular file.  The result is up to the comparison policy. */
+    else results[i] = policy->compare(src, dst[i], &src_stat, &dst_stat, windows[i]);
+
+    /* If the destination file exists, note which device it is on. */
+    if (devices && results[i] != COMPARE_FILES_ERROR && results[i] != COMPARE_FILES_DST_NO_EXIST)
+    {
+      devices[i + 1] = (unsigned char)device_find(dst_stat.st_dev);
+    }
+  }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare a source file to a destination file by their modification times (the default policy): a file is copied if it is
+ * newer in the source directory.  (If sampling, files of the same age are different if their sizes or sampled contents are.)
+ *   src:  absolute pathname of source file
+ *   dst:  absolute pathname of destination file
+ *   src_stat:  status of source file
+ *   dst_stat:  status of destination file
+ *   window:  tolerance (see compare_times) for the modification time of the destination file
+ * Return Value:  Result of comparison.
+ */
+enum compare_files_result compare_by_time(const char * src, const char * dst, const struct stat * src_stat,
+                                          const struct stat * dst_stat, long long window)
+{
+  int i = compare_times(src_stat->st_mtime, STAT_MTIME_NSEC(*src_stat),
+                        dst_stat->st_mtime, STAT_MTIME_NSEC(*dst_stat), window);
+
+  /* If one file is newer than the other, that is the result (and if the source is newer, so is how their sizes compare). */
+  if (i < 0) return COMPARE_FILES_DST_NEWER;
+  if (i > 0) return (src_stat->st_size > dst_stat->st_size) ? COMPARE_FILES_SRC_LARGER : COMPARE_FILES_SRC_NEWER;
+
+  /* The files are the same age. */
+  if (!sample) return COMPARE_FILES_SAME_AGE;
+  if (src_stat->st_size != dst_stat->st_size) return COMPARE_FILES_DIFFERENT;
+  i = compare_contents(src, dst, (size_t)src_stat->st_size, 1);
+  return (i < 0) ? COMPARE_FILES_ERROR : i ? COMPARE_FILES_DIFFERENT : COMPARE_FILES_SAME_AGE;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare a source file to a destination file by their sizes (as for a log that is only ever appended): a file is copied if
+ * its size is different in the source directory, whatever the times.
+ *   src:  absolute pathname of source file
+ *   dst:  absolute pathname of destination file
+ *   src_stat:  status of source file
+ *   dst_stat:  status of destination file
+ *   window:  (not used)
+ * Return Value:  Result of comparison.
+ */
+enum compare_files_result compare_by_size(const char * src, const char * dst, const struct stat * src_stat,
+                                          const struct stat * dst_stat, long long window)
+{
+  return (src_stat->st_size == dst_stat->st_size) ? COMPARE_FILES_SAME_SIZE : COMPARE_FILES_SIZE_DIFFERS;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare a source file to a destination file by their contents (as for a configuration file, whose time says little): a
+ * file is copied if its contents are different in the source directory.  (Files of different sizes are different without
+ * reading them; otherwise, they are read whole.)
+ *   src:  absolute pathname of source file
+ *   dst:  absolute pathname of destination file
+ *   src_stat:  status of source file
+ *   dst_stat:  status of destination file
+ *   window:  (not used)
+ * Return Value:  Result of comparison.
+ */
+enum compare_files_result compare_by_checksum(const char * src, const char * dst, const struct stat * src_stat,
+                                              const struct stat * dst_stat, long long window)
+{
+  int i;
+
+  if (src_stat->st_size != dst_stat->st_size) return COMPARE_FILES_CONTENTS_DIFFER;
+  i = compare_contents(src, dst, (size_t)src_stat->st_size, 0);
+  return (i < 0) ? COMPARE_FILES_ERROR : i ? COMPARE_FILES_CONTENTS_DIFFER : COMPARE_FILES_SAME_CONTENTS;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare a source file to a destination file for a mirror: a file is copied if its time or size is different in the source
+ * directory (even if it is older there, since the destination is to match the source exactly).
+ *   src:  absolute pathname of source file
+ *   dst:  absolute pathname of destination file
+ *   src_stat:  status of source file
+ *   dst_stat:  status of destination file
+ *   window:  tolerance (see compare_times) for the modification time of the destination file
+ * Return Value:  Result of comparison.
+ */
+enum compare_files_result compare_for_mirror(const char * src, const char * dst, const struct stat * src_stat,
+                                             const struct stat * dst_stat, long long window)
+{
+  int i = compare_times(src_stat->st_mtime, STAT_MTIME_NSEC(*src_stat),
+                        dst_stat->st_mtime, STAT_MTIME_NSEC(*dst_stat), window);
+
+  if (i < 0) return COMPARE_FILES_DST_REPLACE;
+  if (i > 0) return (src_stat->st_size > dst_stat->st_size) ? COMPARE_FILES_SRC_LARGER : COMPARE_FILES_SRC_NEWER;
+  return (src_stat->st_size == dst_stat->st_size) ? COMPARE_FILES_SAME_AGE : COMPARE_FILES_SIZE_DIFFERS;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare a source file to a destination file for an archive, in which nothing is ever overwritten: since the destination
+ * file exists, it is not copied.  (Only files that do not exist in the destination directory are copied.)
+ *   src:  absolute pathname of source file
+ *   dst:  absolute pathname of destination file
+ *   src_stat:  status of source file
+ *   dst_stat:  status of destination file
+ *   window:  (not used)
+ * Return Value:  Result of comparison.
+ */
+enum compare_files_result compare_never(const char * src, const char * dst, const struct stat * src_stat,
+                                        const struct stat * dst_stat, long long window)
+{
+  return COMPARE_FILES_DST_EXISTS;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare two modification times, to the nanosecond (give or take a tolerance).  If either time has no fraction of a second,
+ * though, only the seconds are compared, since that time was probably kept (or set) by something that keeps only seconds.
+ *   a:  first time (seconds part)
+ *   a_nsec:  first time (nanoseconds part)
+ *   b:  second time (seconds part)
+ *   b_nsec:  second time (nanoseconds part)
+ *   window:  number of nanoseconds by which the times may differ and still be considered the same
+ * Return Value:  Negative, zero, or positive, depending on whether the first time is earlier than, the same as, or later
+ *   than the second.
+ */
+int compare_times(time_t a, long a_nsec, time_t b, long b_nsec, long long window)
+{
+  long long d = (long long)a - (long long)b;
+
+  if (!a_nsec || !b_nsec) a_nsec = b_nsec = 0;
+  if (d > 1000000000 || d < -1000000000) return (d > 0) ? 1 : -1;
+  d = d * 1000000000 + (a_nsec - b_nsec);
+  return (d > window) ? 1 : (d < -window) ? -1 : 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Find how finely the filesystem of a directory keeps modification times (which is the tolerance needed to compare files
+ * in it to those copied there from a filesystem that keeps them more finely).
+ *   dir:  pathname of directory
+ * Return Value:  Resolution (in nanoseconds) of modification times, or zero if they are kept to the nanosecond (or the
+ *   filesystem is not known to keep them any less finely).
+ */
+long long mtime_window(const char * dir)
+{
+#ifdef _WIN32
+  char r[MAX_PATH], s[MAX_PATH];
+
+  /* (Windows does not provide fractions of a second anyway, so only FAT and exFAT, which keep every other second, matter.) */
+  if (!GetVolumePathNameA(dir, r, MAX_PATH) || !GetVolumeInformationA(r, NULL, 0, NULL, NULL, NULL, s, MAX_PATH)) return 0;
+  return (!strncmp(s, "FAT", 3) || !strcmp(s, "exFAT")) ? 2000000000 : 0;
+#else
+  struct statfs s;
+
+  if (statfs(dir, &s)) return 0;
+  switch ((unsigned int)s.f_type)
+  {
+    case FS_TYPE_MSDOS: case FS_TYPE_EXFAT: return 2000000000;
+    case FS_TYPE_CIFS: case FS_TYPE_SMB2: case FS_TYPE_SMB: case FS_TYPE_NTFS: case FS_TYPE_NTFS3: return 100;
+  }
+  return 0;
+#endif
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Find when a destination directory was last synced in full (i.e., when that sync began, as recorded by write_epoch), less
+ * a margin.  A source file modified before then is assumed to be synced to the directory, as long as the same files are
+ * synced each time (and nothing else modifies the destination files).
+ *   dir:  destination directory pathname
+ * Return Value:  Time before which source files are assumed synced (or, if the directory was never synced in full, zero).
+ */
+time_t read_epoch(const char * dir)
+{
+  char s[JB_PATH_MAX_LENGTH];
+  long long t = 0;
+  FILE * f;
+
+  path_build(s, dir, EPOCH_FILE_NAME);
+  if (!(f = fopen(s, "rb"))) { if (errno != ENOENT) perror(s); return 0; }
+  if (fscanf(f, "%lld", &t) != 1 || t < EPOCH_MARGIN) t = EPOCH_MARGIN;
+  fclose(f);
+  return (time_t)(t - EPOCH_MARGIN);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Record when a sync (of every file to a destination directory) began, in the directory (see read_epoch).
+ *   dir:  destination directory pathname
+ *   epoch:  time at which the sync began
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int write_epoch(const char * dir, time_t epoch)
+{
+  char s[JB_PATH_MAX_LENGTH];
+  FILE * f;
+
+  path_build(s, dir, EPOCH_FILE_NAME);
+  if (!(f = fopen(s, "wb"))) { perror(s); return -1; }
+  if ((fprintf(f, "%lld\n", (long long)epoch) < 0) | fclose(f)) { perror(s); return -1; }
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare the contents of two files of the same size, either whole or by sampling them: the first block, the last block, and
+ * a few others (chosen at random, so that repeated syncs sample different parts of a large file).  (A small file is compared
+ * whole either way.)  Sampling reads a few hundred KiB of a large file, rather than all of it, yet catches most edits of files
+ * whose modification times were restored afterward (which, as far as their timestamps are concerned, are the same age).
+ *   src:  absolute pathname of source file
+ *   dst:  absolute pathname of destination file
+ *   size:  size (in bytes) of each file
+ *   sampled:  nonzero if the files are to be sampled (rather than compared whole)
+ * Return Value:  Zero if the contents (or samples) are the same, positive if they are different, or negative if an error
+ *   occurred.
+ */
+int compare_contents(const char * src, const char * dst, size_t size, int sampled)
+{
+  size_t o[SAMPLE_BLOCK_COUNT], b = (size + SAMPLE_BLOCK_SIZE - 1) / SAMPLE_BLOCK_SIZE, c, i, n, m;
+  unsigned int x = (unsigned int)time(NULL) ^ (unsigned int)size;
+  FILE * f, * g;
+  char * p;
+  int r = 0;
+
+  /* If sampling (a file large enough for it to matter), choose the blocks to compare: the first, one at random from each of
+   * equal stretches of those in between, and the last.  (They are in ascending order, so that each file is read from
+   * beginning to end.)  Otherwise, every block is compared, in order.
+   */
+  if (!sampled || b <= SAMPLE_BLOCK_COUNT) c = b;
+  else
+  {
+    o[0] = 0;
+    for (c = 1; c < SAMPLE_BLOCK_COUNT - 1; ++c)
+    {
+      x = x * 1103515245 + 12345;
+      n = 1 + (b - 2) * (c - 1) / (SAMPLE_BLOCK_COUNT - 2);
+      m = 1 + (b - 2) * c / (SAMPLE_BLOCK_COUNT - 2);
+      o[c] = n + (size_t)(x >> 8) % (m - n);
+    }
+    o[c++] = b - 1;
+  }
+
+  /* Open both files (each of which, and each block read, counts against the I/O operation limit). */
+  if (!(p = (char *)malloc(2 * SAMPLE_BLOCK_SIZE))) { perror("malloc"); return -1; }
+  limit_take(&operations, 2);
+  if (!(f = fopen(src, "rb"))) { perror("fopen"); free(p); return -1; }
+  if (!(g = fopen(dst, "rb"))) { perror("fopen"); fclose(f); free(p); return -1; }
+
+  /* Compare each block. */
+  for (i = 0; i < c && !r; ++i)
+  {
+    limit_take(&operations, 2);
+    if (c < b && (FILE_SEEK(f, o[i] * SAMPLE_BLOCK_SIZE) || FILE_SEEK(g, o[i] * SAMPLE_BLOCK_SIZE)))
+    {
+      perror("fseek"); r = -1; break;
+    }
+    n = fread(p, 1, SAMPLE_BLOCK_SIZE, f);
+    m = fread(p + SAMPLE_BLOCK_SIZE, 1, SAMPLE_BLOCK_SIZE, g);
+    if (ferror(f) || ferror(g)) { perror("fread"); r = -1; }
+    else if (n != m || memcmp(p, p + SAMPLE_BLOCK_SIZE, n)) r = 1;
+  }
+  fclose(f);
+  fclose(g);
+  free(p);
+  return r;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copy a file to one or more destinations.
+ * (While it might be tempting to have the shell/OS execute this command (say,
  * via the 'system' function), we choose not to, for the following reasons:
  *   - Portability.  The command would be different depending on the OS ('copy' on Win32 vs. 'cp' on Linux).
  *   - Efficiency.  We'd rather not spawn a child process if we don't have to.
  * Surprisingly, there's no cross-platform functionality to do this without invoking the
  * shell/OS.  (Win32 has CopyFile, but Linux has no equivalent.)  Thus, we write our own.)
+ * The source file is read one block at a time, and each block is written to every destination
+ * file before the next block is read, so that the source file is read only once.  (If the copies
+ * are to be verified, or the source file hashed, the CRC or hash is computed along the way, for
+ * the same reason.)
  *   src:  absolute pathname of source file
- *   dst:  absolute pathname of destination file
+ *   dst:  absolute pathnames of destination files
+ *   dst_count:  number of pathnames in dst
  *   size:  size (in bytes) of source file
  *   mtime:   modification time of source file
+ *   nsec:  nanoseconds part of modification time of source file
+ *   offset:  number of bytes already copied (i.e., at which to resume an interrupted copy), or zero to copy the whole file
+ *   path:  relative pathname under which to record the progress of copying a large file in the journal (or NULL, if none)
+ *   dsts:  destinations (by DEST number) to which the file is being copied (bit i for DEST i + 1, as recorded in the journal)
+ *   attempts:  number of times to copy the file again to any destination whose copy fails verification (or, if negative,
+ *     the copies are not verified)
+ *   hash:  receives SHA-256 of source file (SHA256_SIZE bytes), unless NULL (or the source file could not be read)
+ * Return Value:  Number of destination files successfully copied (and, if applicable, verified).
  */
-void copy_file(const char * src, const char * dst, size_t size, time_t mtime)
+int copy_file(const char * src, const char ** dst, int dst_count, size_t size, time_t mtime, long nsec,
+              size_t offset, const char * path, unsigned int dsts, int attempts, unsigned char * hash)
 {
+  FILE * f, * g[MAX_DEST_COUNT];
+  const char * e[MAX_DEST_COUNT];
+  struct sha256 h;
   void * p;
-  int n;
-  struct utimbuf t;
+  size_t k, n, c = offset, o = offset, v = 0, l;
+  int i, j, m;
+  unsigned int b, x = 0, y;
+
+  /* Allocate memory for a buffer to store each block read from the source file. */
+  k = (size < COPY_BLOCK_SIZE) ? size + 1 : COPY_BLOCK_SIZE;
+  if (!(p = malloc(k))) { perror("malloc"); return 0; }
+
+  /* Open the source file for reading (at the offset, if resuming).  (See the comment on fopen in jb_file_read.)
+   * Each file opened counts against the I/O operation limit (as does each block read or written, below).
+   */
+  limit_take(&operations, 1 + dst_count);
+  if (!(f = fopen(src, "rb"))) { perror("fopen"); free(p); return 0; }
+
+  /* If the source file is being hashed, the part of it already copied (if resuming) must be read anyway, to be hashed. */
+  if (hash) sha256_init(&h);
+  if (offset && hash)
+  {
+    for (l = 0; l < offset && (n = fread(p, 1, (offset - l < k) ? offset - l : k, f)); l += n) sha256_update(&h, p, n);
+    if (l < offset) { perror("fread"); fclose(f); free(p); return 0; }
+  }
+  else if (offset && FILE_SEEK(f, offset)) { perror("fseek"); fclose(f); free(p); return 0; }
+
+  /* Create each destination file (or, if resuming, open it at the offset).  (If one cannot be, the others are still written.) */
+  for (i = m = 0; i < dst_count; ++i)
+  {
+    if (!offset) { if (g[i] = jb_file_create(dst[i])) ++m; continue; }
+    if (!(g[i] = fopen(dst[i], "r+b"))) { perror("fopen"); continue; }
+    if (!FILE_SEEK(g[i], offset)) { ++m; continue; }
+    perror("fseek"); fclose(g[i]); g[i] = NULL;
+  }
+
+  /* Write each block of the source file to every destination file that is still open.  If a write fails, give up on
+   * that destination (and remove what was written of it, lest it be mistaken for a newer file the next time this runs).
+   */
+  while (m && (n = fread(p, 1, k, f)))
+  {
+    pressure_check();
+    tune_check();
+
+    /* (The bandwidth limit applies to the bytes written, since that is what each destination's disk sees.) */
+    limit_take(&operations, 1 + m);
+    limit_take(&bandwidth, (double)n * m);
+    if (attempts >= 0) { x = crc_update(x, p, n); v += n; }
+    if (hash) sha256_update(&h, p, n);
+    for (i = 0; i < dst_count; ++i)
+    {
+      if (!g[i] || fwrite(p, 1, n, g[i]) == n) continue;
+      perror("fwrite"); fclose(g[i]); g[i] = NULL; --m; remove(dst[i]);
+    }
+
+    /* Every so often (while copying a large file), flush the destination files to disk, and then record in the journal
+     * how much has been copied to them.  (If the copy is interrupted, it can then be resumed from there.)
+     */
+    if (!path || (c += n) - offset < COPY_CHECKPOINT_SIZE || c >= size) continue;
+    for (i = 0, b = dsts; i < dst_count; ++i)
+    {
+      /* (The destination files are in order of DEST number, so the lowest bit still set in dsts is that of this one.) */
+      if (g[i] && (fflush(g[i]) || FILE_SYNC(g[i]))) { perror("fsync"); break; }
+      if (!g[i]) dsts &= ~(b & -b);
+      b &= b - 1;
+    }
+    if (i == dst_count) { journal_progress(journal, path, c, size, mtime, dsts); offset = c; }
+  }
+  if (n = ferror(f)) perror("fread"); else if (hash) sha256_final(&h, hash);
+  fclose(f);
 
-  /* Read the file into a buffer. */
-  if (!(p = jb_file_read(src, size))) return;
+  /* Close each destination file.  (If the source file could not be read in its entirety, remove the incomplete copies.)
+   * If the copies are to be verified, flush them to disk first, so that they can be read back from there.
+   */
+  for (i = 0; i < dst_count; ++i)
+  {
+    if (!g[i]) continue;
+    if (attempts >= 0 && !n && (fflush(g[i]) || FILE_SYNC(g[i]))) { perror("fsync"); fclose(g[i]); }
+    else if (fclose(g[i])) perror("fclose"); else if (!n) continue;
+    g[i] = NULL; remove(dst[i]);
+  }
 
-  /* Write the contents of the buffer (source file) to the destination file. */
-  n = jb_file_write(dst, p, size);
+  /* If the copies are to be verified, read each one back, and make sure that it matches the source file (by CRC, and
+   * length).  Any that does not (or cannot be read back at all) is set aside, to be copied again (or, if there are no
+   * attempts left, removed).
+   */
+  for (i = j = 0; attempts >= 0 && !n && i < dst_count; ++i)
+  {
+    if (!g[i]) continue;
+    if (verify_file(dst[i], o, p, k, &y, &l)) fprintf(stderr, STR_UNVERIFIED_FORMAT, dst[i]);
+    else if (y == x && l == v) continue;
+    else fprintf(stderr, STR_VERIFY_FORMAT, dst[i], y, x);
+    e[j++] = dst[i];
+    g[i] = NULL;
+    if (!attempts) remove(dst[i]);
+  }
   free(p);
-  if (n) return;
 
-  /* Set the modification time of the destination file to that of the source file, so that the next time
+  /* Set the modification time of each destination file to that of the source file, so that the next time
    * this runs, we realize that the source and destination files are identical (size-wise and time-wise).
    */
+  for (i = m = 0; i < dst_count; ++i) if (g[i]) { if (touch_file(dst[i], mtime, nsec)) perror("utime"); else ++m; }
+
+  /* Copy the file again to any destination whose copy failed verification.  (That copy is not recorded in the journal.) */
+  if (j && attempts > 0) m += copy_file(src, e, j, size, mtime, nsec, 0, NULL, 0, attempts - 1, NULL);
+  return m;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Set the modification time of a file (to the nanosecond, except on Windows, which keeps only seconds), and its access time
+ * to the current time.
+ *   path:  pathname of file
+ *   mtime:  modification time (seconds part)
+ *   nsec:  modification time (nanoseconds part)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int touch_file(const char * path, time_t mtime, long nsec)
+{
+#ifdef _WIN32
+  struct utimbuf t;
+
   t.actime = time(NULL);
   t.modtime = mtime;
-  if (utime(dst, &t)) perror("utime");
+  return utime(path, &t);
+#else
+  struct timespec t[2];
+
+  t[0].tv_sec = 0;
+  t[0].tv_nsec = UTIME_NOW;
+  t[1].tv_sec = mtime;
+  t[1].tv_nsec = nsec;
+  return utimensat(AT_FDCWD, path, t, 0);
+#endif
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Read a file (from disk, rather than from cache, if it has been flushed) to compute its CRC.
+ *   path:  absolute pathname of file
+ *   offset:  offset at which to begin reading
+ *   buffer:  buffer into which to read each block
+ *   size:  size (in bytes) of buffer
+ *   crc_ptr:  receives CRC of the file (from offset to end)
+ *   length_ptr:  receives number of bytes read
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int verify_file(const char * path, size_t offset, void * buffer, size_t size, unsigned int * crc_ptr, size_t * length_ptr)
+{
+  FILE * f;
+  size_t n;
+  int r;
+
+  /* Open the file (at the offset), and evict it from cache, so that reading it tests what actually landed on disk.
+   * (Each file opened, and each block read, counts against the I/O operation limit.)
+   */
+  limit_take(&operations, 1);
+  if (!(f = fopen(path, "rb"))) { perror("fopen"); return -1; }
+  if (offset && FILE_SEEK(f, offset)) { perror("fseek"); fclose(f); return -1; }
+  FILE_EVICT(f);
+
+  /* Read the file one block at a time, updating the CRC with each. */
+  *crc_ptr = 0;
+  *length_ptr = 0;
+  for (;;)
+  {
+    limit_take(&operations, 1);
+    if (!(n = fread(buffer, 1, size, f))) break;
+    *crc_ptr = crc_update(*crc_ptr, buffer, n);
+    *length_ptr += n;
+  }
+  if (r = ferror(f)) perror("fread");
+  fclose(f);
+  return r;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Purge a directory (as a work_task_function, so that when the purge is shared among the threads, each subdirectory to be
+ * purged is a task, which one of them does, while another may steal the next; see purge_file).
+ *   context:  state of the purge
+ *   task:  directory (allocated by malloc, and freed once it has been purged)
+ *   number:  number of the thread doing the task (or, if the purge is not shared among threads, negative)
+ */
+void purge_directory(void * context, void * task, int number)
+{
+  struct purge_task * t = (struct purge_task *)task;
+
+  t->number = number;
+  t->dirty = 0;
+  purge_files(t->src, t->dst, (struct purge_context *)context, t);
+  free(t);
 }
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
- * Report files in the destination directory for which there are not corresponding files in the source directory.
- *   src:  source directory pathname
+ * Report (and, if specified, delete) files in the destination directory for which there are not corresponding files in
+ * the source directory.  If a directory cache is kept, and the destination directory had nothing to purge the last time, and
+ * neither it nor the source directory has been modified since (so that no file has been added to the one, or removed from
+ * the other), its files need not be checked (although its subdirectories still are, since their contents may have changed
+ * without changing its modification time).
+ *   src:  source directory pathname (or, if NULL, there is no corresponding source
+ *     directory, and every file in the destination directory is silently deleted)
  *   dst:  destination directory pathname
- *   offset:  offset into absolute pathname of destination file at which to begin output
- *   paths:  pathnames of files to skip (because they are known to exist in the source directory)
- *   path_count:  number of pathnames in paths
+ *   context:  state of the purge
+ *   task:  task of which the purge is part (see purge_directory)
+ * Return Value:  Number of files in the destination directory that should have been deleted, but were not.
  */
-void purge_files(const char * src, const char * dst, int offset, char ** paths, int path_count)
+int purge_files(const char * src, const char * dst, struct purge_context * context, struct purge_task * task)
 {
-  int i;
-  char * q;
+  int i, k, n = 0, b = 0, dirty = task->dirty;
+  char * q, s[JB_PATH_MAX_LENGTH];
+  struct purge_entries entries = { 0 };
+  struct delete_batch files = { 0 }, dirs = { 0 };
+  long long x = 0, y = 0;
+  struct stat st;
 #ifdef _WIN32
-  char s[JB_PATH_MAX_LENGTH];
   intptr_t p;
   struct _finddata_t d;
 #else
-  DIR * p;
-  struct dirent * d;
+  int p;
 #endif
 
-  /* Iterate through each filename entry in the destination directory. */
+  /* If a directory cache is kept, find the modification times (in nanoseconds) of the source and destination directories, and
+   * whether the destination directory is known to have nothing to purge (as long as those times have not changed).  (Like
+   * every other stat, open, and read of the purge, each stat counts against the I/O operation limit.)
+   */
+  if (src && context->cache)
+  {
+    limit_take(&operations, 1);
+    if (!stat(src, &st))
+    {
+      x = (long long)st.st_mtime * 1000000000 + STAT_MTIME_NSEC(st);
+      limit_take(&operations, 1);
+      if (!stat(dst, &st)) y = (long long)st.st_mtime * 1000000000 + STAT_MTIME_NSEC(st);
+      b = y && dircache_find(context->cache, dst, x, y);
+    }
+  }
+  task->dirty = 0;
+
+  /* Read the filename entries in the destination directory (noting whether or not each is actually a directory), and sort
+   * them as if the name of each directory ended with a separator, so that the files in the directory (and, recursively, in
+   * its subdirectories) are visited in the order of their pathnames (as the files to skip are looked up; see purge_find).
+   */
+  limit_take(&operations, 1);
 #ifdef _WIN32
   ((char *)memcpy(s, dst, (i = strlen(dst))))[i] = JB_PATH_SEPARATOR;
   s[++i] = '*'; s[++i] = '\0';
-  if ((p = _findfirst(s, &d)) < 0) { perror("_findfirst"); return; }
-  do
+  if ((p = _findfirst(s, &d)) < 0) { perror("_findfirst"); return 1; }
+  files.dir = dirs.dir = dst;
+  do purge_entries_add(&entries, d.name, (d.attrib & _A_SUBDIR) != 0); while (!_findnext(p, &d));
 #else
-  if (!(p = opendir(dst))) { perror("opendir"); return; }
-  while (d = readdir(p))
+  if ((p = open(dst, O_RDONLY | O_DIRECTORY)) < 0) { perror("open"); return 1; }
+  files.dir = dirs.dir = p;
+  if (purge_read(p, &entries)) { purge_entries_free(&entries); close(p); return 1; }
 #endif
+  qsort(entries.names, entries.count, sizeof(char *), compare_purge_entries);
+
+  /* Iterate through each filename entry. */
+  for (k = 0; k < entries.count; ++k)
   {
     /* Determine the name of the file, and whether or not it's actually a directory. */
-#ifdef _WIN32
-    q = d.name; i = (d.attrib & _A_SUBDIR);
-#else
-    q = d->d_name; i = (d->d_type == DT_DIR);
-#endif
+    q = entries.names[k] + 1; i = entries.names[k][0];
 
     /* Report the file if appropriate (i.e., if there is not a corresponding file in the source directory).
-     * (If the file is actually a directory, its contents are purged recursively if needed.)
+     * (If the file is actually a directory, its contents are purged recursively if needed.)  Files to be
+     * deleted are batched, since the directory should not be modified while its entries are being read.
+     * (If the directory is known to have nothing to purge, only its subdirectories need to be checked.)
      */
-    purge_file(q, i, src, dst, offset, paths, path_count);
-#ifdef _WIN32
-  } while (!_findnext(p, &d));
-#else
+    if (b && !i) continue;
+    if ((i = purge_file(q, i, src, dst, context, task)) > 0) delete_batch_add(i > 1 ? &dirs : &files, q);
+    else if (i < 0) ++n;
   }
-#endif
+
+  /* Delete the contents of each directory to be deleted (so that it can then be deleted itself). */
+  for (i = 0; i < dirs.count; ++i)
+  {
+    path_build(s, dst, dirs.names[i]);
+    if (purge_files(NULL, s, context, task)) { dirs.failed[i] = 1; ++n; }
+  }
+
+  /* Unless this is a dry run, delete the files (sharing them among the worker threads, unless they are already sharing the
+   * purge), and then the (empty) directories.
+   */
+  if (!(context->flags & PURGE_FILES_DRY_RUN))
+  {
+    if (task->number >= 0) for (i = 0; i < files.count; ++i) delete_file(&files, i);
+    else work_run(delete_file, &files, files.count);
+    for (i = 0; i < files.count; ++i) if (files.failed[i]) ++n;
+    for (i = 0; i < dirs.count; ++i) if (!dirs.failed[i] && delete_directory(&dirs, i)) ++n;
+  }
+
+  /* If nothing was reported in the directory, record that it has nothing to purge (with the times of the directories). */
+  if (y && !task->dirty && !n) purge_record(context, task, dst, x, y);
+  task->dirty = dirty;
 
   /* All done. */
+  purge_entries_free(&entries);
+  delete_batch_free(&files);
+  delete_batch_free(&dirs);
 #ifdef _WIN32
   _findclose(p);
 #else
-  closedir(p);
+  close(p);
 #endif
+  return n;
 }
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
  * Report a file in the destination directory if there is not a corresponding file in the source directory.
  *   name:  filename (without path)
  *   dir:  nonzero if name is a directory; otherwise, zero
- *   src:  source directory pathname
+ *   src:  source directory pathname (or NULL; see purge_files)
  *   dst:  destination directory pathname
- *   offset:  offset into absolute pathname of destination file at which to begin output
- *   paths:  pathnames of files to skip (because they are known to exist in the source directory)
- *   path_count:  number of pathnames in paths
+ *   context:  state of the purge
+ *   task:  task of which the purge is part (see purge_directory)
+ * Return Value:
+ *   If positive, the file should be deleted (and if greater than one, it is a directory).
+ *   Otherwise, if negative, the file should be deleted, but may not be (because of the deletion limit).
+ *   Otherwise, the file should not be deleted.
  */
-void purge_file(const char * name, int dir, const char * src, const char * dst, int offset, char ** paths, int path_count)
+int purge_file(const char * name, int dir, const char * src, const char * dst, struct purge_context * context,
+               struct purge_task * task)
 {
-  char * p, r[JB_PATH_MAX_LENGTH], s[JB_PATH_MAX_LENGTH];
+  static const int j = MAX_LINE_LENGTH - 18;
+
+  char r[JB_PATH_MAX_LENGTH], s[JB_PATH_MAX_LENGTH];
   size_t n;
-  int i, b = 0;
+  int b = 0;
   struct stat st;
+  struct purge_task * t;
 
-  /* Skip the current and parent directories. */
-  if (dir && (!strcmp(name, ".") || !strcmp(name, ".."))) return;
+  /* Skip the current and parent directories (and the record of the last full sync, at the top of the destination). */
+  if (dir && (!strcmp(name, ".") || !strcmp(name, ".."))) return 0;
+  if (!dir && (int)strlen(dst) <= context->offset && !strcmp(name, EPOCH_FILE_NAME)) return 0;
+  pressure_check();
+  tune_check();
 
-  /* Build the absolute pathname of the source file. */
-  path_build(r, src, name);
-  if (dir)
+  /* If there is a source directory, determine whether or not the file exists in it. */
+  if (src)
   {
-    r[n = strlen(r)] = JB_PATH_SEPARATOR; r[++n] = '\0';
+    /* Build the absolute pathnames of the source and destination files.  (The relative pathname of either is the
+     * part of that of the destination file at which output begins.)
+     */
+    path_build(r, src, name);
+    path_build(s, dst, name);
+    if (dir)
+    {
+      /* If any pathname in the set of files to skip is within the directory, don't report it. */
+      s[n = strlen(s)] = JB_PATH_SEPARATOR; s[n + 1] = '\0';
+      b = purge_find(context, task, s + context->offset, 1);
+      s[n] = '\0';
+    }
+    else
+    {
+      /* If the file belongs to another shard, leave it to that one.  (It would not be in the set of files to skip anyway.) */
+      if (path_shard(s + context->offset, context->shard_count) != context->shard) return 0;
+      b = purge_find(context, task, s + context->offset, 0);
+    }
 
-    /* If the pathname appears in the list of files to skip, don't report it. */
-    for (i = 0; i < path_count; ++i)
+    /* If the file was not skipped, check for its existence in the source directory. */
+    if (!b)
     {
-      if (strlen(p = paths[i]) < n) continue;
-      if (!strncmp(p, r, n)) { b = 1; break; }
+      /* If the file exists in the source directory, don't report it. */
+      limit_take(&operations, 1);
+      if (!stat(r, &st)) b = 1;
+
+      /* If an error occurred, report the error and be done. */
+      else if (errno != ENOENT) { perror("stat"); task->dirty = 1; return 0; }
     }
-    r[--n] = '\0';
-  } else for (i = 0; i < path_count; ++i) if (!strcmp(paths[i], r)) { b = 1; break; }
 
-  /* If the file was not skipped, check for its existence in the source directory. */
-  if (!b)
-  {
-    /* If the file exists in the source directory, don't report it. */
-    if (!stat(r, &st)) b = 1;
+    /* If the file is now known to exist in the source directory (i.e., it
+     * is not being reported) and it is not a directory, we can be done.
+     */
+    if (b && !dir) return 0;
+
+    /* If the file is a directory (and there is a corresponding subdirectory in the source directory), recursively
+     * purge its contents.  (If the purge is shared among the threads, that is a new task, which starts where this
+     * one is in the files to skip, since the files in the subdirectory are the next ones to be looked up.)
+     */
+    if (b && task->number < 0) { purge_files(r, s, context, task); return 0; }
+    if (b)
+    {
+      if (!(t = (struct purge_task *)malloc(sizeof(struct purge_task)))) { perror("malloc"); task->dirty = 1; return 0; }
+      memcpy(t->src, r, strlen(r) + 1);
+      memcpy(t->dst, s, strlen(s) + 1);
+      t->cursor = task->cursor;
+      work_add(task->number, t);
+      return 0;
+    }
 
-    /* If an error occurred, report the error and be done. */
-    else if (errno != ENOENT) { perror("stat"); return; }
+    /* If the file (or directory) belongs to another shard, leave it to that one. */
+    if (path_shard(s + context->offset, context->shard_count) != context->shard) return 0;
   }
 
-  /* If the file is now known to exist in the source directory (i.e., it
-   * is not being reported) and it is not a directory, we can be done.
+  /* The file does not exist in the source directory, so it probably should not exist in the destination
+   * directory either.  If it is to be deleted, make sure that doing so does not exceed the deletion limit.
    */
-  if (b && !dir) return;
-
-  /* Build the absolute pathname of the destination file. */
-  path_build(s, dst, name);
+  if (b = (context->flags & PURGE_FILES_DELETE) && context->limit)
+  {
+    if (context->limit > 0) --context->limit;
+  }
+  else if (context->flags & PURGE_FILES_DELETE) context->limited = 1;
 
-  /* If the file does not exist in the source directory, it probably
-   * should not exist in the destination directory either, so report it.
+  /* Report it (unless it is being silently deleted along with the rest of its directory).  If the purge is shared among
+   * the threads, it is output later, in order (see purge_output).
    */
-  if (!b) path_output(s + offset, MAX_LINE_LENGTH);
+  if (src)
+  {
+    if (task->number >= 0) purge_entries_add(&context->results[task->number].reports, s + context->offset, dir);
+    else if (!(context->flags & PURGE_FILES_DELETE)) path_output(s + context->offset, MAX_LINE_LENGTH);
+    else { path_output(s + context->offset, j); puts(b ? STR_DELETE : STR_OVER_LIMIT); }
+    task->dirty = 1;
+  }
+  return b ? (dir ? 2 : 1) : (context->flags & PURGE_FILES_DELETE) ? -1 : 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Determine whether or not a file is among those to skip (whether they are in a path set or were spilled to disk).  Either
+ * way, this moves forward through them, so files must be looked up in the order of their pathnames (see purge_files).
+ *   context:  state of the purge
+ *   task:  task of which the purge is part (see purge_directory)
+ *   path:  relative pathname of file
+ *   prefix:  nonzero if any pathname that begins with path counts; otherwise, zero (if only path itself counts)
+ * Return Value:  Nonzero if the file is to be skipped; otherwise, zero.
+ */
+int purge_find(struct purge_context * context, struct purge_task * task, const char * path, int prefix)
+{
+  return context->paths ? pathset_seek(&task->cursor, path, prefix) : spill_find(context->spill, path, prefix);
+}
+
+#ifndef _WIN32
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Read the entries of a directory being purged (as many at a time as fit in a large buffer, so that a huge directory takes
+ * far fewer system calls than readdir would make), noting whether or not each is a directory.  Some filesystems do not say
+ * (for some or all entries), so once every entry has been read, those whose types are not known are stat'ed.
+ *   dir:  file descriptor of directory
+ *   entries:  entries of directory (to which those read are added)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int purge_read(int dir, struct purge_entries * entries)
+{
+  struct purge_dirent * d;
+  struct stat st;
+  char * p, * q;
+  long i, n;
+  int k;
+
+  /* Read as many entries as fit in the buffer, until there are no more. */
+  if (!(p = (char *)malloc(PURGE_READ_SIZE))) { perror("malloc"); return -1; }
+  for (;;)
+  {
+    limit_take(&operations, 1);
+    if ((n = syscall(SYS_getdents64, dir, p, PURGE_READ_SIZE)) <= 0) break;
+    for (i = 0; i < n; i += d->reclen)
+    {
+      d = (struct purge_dirent *)(p + i);
+      purge_entries_add(entries, d->name, (d->type == DT_DIR) ? 1 : (d->type == DT_UNKNOWN) ? PURGE_ENTRY_UNKNOWN : 0);
+    }
+  }
+  free(p);
+  if (n < 0) { perror("getdents64"); return -1; }
 
-  /* Otherwise, the file must be a directory (and there is a corresponding
-   * subdirectory in the source directory).  Recursively purge its contents.
+  /* Find out whether or not each entry whose type is not known is a directory (without following symbolic links, just as
+   * if its type had been read).  If it cannot be stat'ed, it is taken not to be one.
    */
-  else purge_files(r, s, offset, paths, path_count);
+  for (k = 0; k < entries->count; ++k)
+  {
+    if ((q = entries->names[k])[0] != PURGE_ENTRY_UNKNOWN) continue;
+    limit_take(&operations, 1);
+    if (fstatat(dir, q + 1, &st, AT_SYMLINK_NOFOLLOW)) { perror("fstatat"); q[0] = 0; }
+    else q[0] = S_ISDIR(st.st_mode) != 0;
+  }
+  return 0;
+}
+#endif
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Record a destination directory that had nothing to purge in the directory cache (or, if the purge is shared among the
+ * threads, in the results of this one, to be put in the directory cache once the purge is done; see purge_output).
+ *   context:  state of the purge
+ *   task:  task of which the purge is part (see purge_directory)
+ *   dst:  destination directory pathname
+ *   src_mtime:  modification time (in nanoseconds since 1970) of source directory
+ *   dst_mtime:  modification time of destination directory
+ */
+void purge_record(struct purge_context * context, struct purge_task * task, const char * dst, long long src_mtime,
+                  long long dst_mtime)
+{
+  struct purge_results * results;
+  struct purge_record * record;
+  size_t n = strlen(dst) + 1;
+
+  if (task->number < 0) { dircache_put(context->cache, dst, src_mtime, dst_mtime); return; }
+
+  /* If necessary, allocate memory for more items (doubling the number allocated each time). */
+  results = &context->results[task->number];
+  if (results->record_count == results->record_size)
+  {
+    results->record_size = results->record_size ? 2 * results->record_size : 16;
+    results->records = (struct purge_record *)realloc(results->records, results->record_size * sizeof(struct purge_record));
+  }
+
+  /* Allocate memory for a new string, and copy the pathname into it. */
+  record = &results->records[results->record_count++];
+  record->path = (char *)malloc(n);
+  memcpy(record->path, dst, n);
+  record->src_mtime = src_mtime;
+  record->dst_mtime = dst_mtime;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Once a purge shared among the threads is done, output the files they reported, in the order of their pathnames (just as
+ * they would have been, one directory at a time), and put the directories they recorded in the directory cache.
+ *   context:  state of the purge
+ */
+void purge_output(struct purge_context * context)
+{
+  static const int j = MAX_LINE_LENGTH - 18;
+
+  struct purge_results * results;
+  char ** a = NULL, * p;
+  int i, k, n = 0;
+
+  /* Gather the files reported by every thread, and sort them (as purge_files sorts the entries of each directory). */
+  for (i = 0; i <= WORK_MAX_JOBS; ++i) n += context->results[i].reports.count;
+  if (n && !(a = (char **)malloc(n * sizeof(char *)))) { perror("malloc"); n = 0; }
+  for (i = n = 0; a && i <= WORK_MAX_JOBS; ++i)
+  {
+    results = &context->results[i];
+    for (k = 0; k < results->reports.count; ++k) a[n++] = results->reports.names[k];
+  }
+  qsort(a, n, sizeof(char *), compare_purge_entries);
+
+  /* Output each file. */
+  for (k = 0; k < n; ++k)
+  {
+    p = a[k] + 1;
+    if (context->flags & PURGE_FILES_DELETE) { path_output(p, j); puts(STR_DELETE); }
+    else path_output(p, MAX_LINE_LENGTH);
+  }
+  free(a);
+
+  /* Put each directory recorded in the directory cache, and clear the results for the next purge. */
+  for (i = 0; i <= WORK_MAX_JOBS; ++i)
+  {
+    results = &context->results[i];
+    for (k = 0; k < results->record_count; ++k)
+    {
+      dircache_put(context->cache, results->records[k].path, results->records[k].src_mtime, results->records[k].dst_mtime);
+      free(results->records[k].path);
+    }
+    free(results->records);
+    purge_entries_free(&results->reports);
+    memset(results, 0, sizeof(struct purge_results));
+  }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Add an entry to the entries of a directory being purged.
+ *   entries:  entries of directory
+ *   name:  filename (without path)
+ *   dir:  1 if name is a directory, 0 if not, or PURGE_ENTRY_UNKNOWN if that is not yet known (see purge_read)
+ */
+void purge_entries_add(struct purge_entries * entries, const char * name, int dir)
+{
+  size_t n = strlen(name) + 1;
+
+  /* If necessary, allocate memory for more items (doubling the number allocated each time). */
+  if (entries->count == entries->size)
+  {
+    entries->size = entries->size ? 2 * entries->size : 16;
+    entries->names = (char **)realloc(entries->names, entries->size * sizeof(char *));
+  }
+
+  /* Allocate memory for a new string, and copy the filename into it (after noting whether or not it is a directory). */
+  entries->names[entries->count] = (char *)malloc(n + 1);
+  entries->names[entries->count][0] = (char)dir;
+  memcpy(entries->names[entries->count++] + 1, name, n);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Free the memory allocated for the entries of a directory being purged.
+ *   entries:  entries of directory
+ */
+void purge_entries_free(struct purge_entries * entries)
+{
+  int i;
+
+  for (i = 0; i < entries->count; ++i) free(entries->names[i]);
+  free(entries->names);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare two entries of a directory being purged (as the comparison function for qsort), as if the name of each directory
+ * ended with a separator (so that they sort the same as the pathnames of the files in them would).
+ *   a:  pointer to first entry (see purge_entries)
+ *   b:  pointer to second entry
+ * Return Value:  Negative, zero, or positive, depending on whether the first entry sorts before, the same as, or after the
+ *   second.
+ */
+int compare_purge_entries(const void * a, const void * b)
+{
+  const unsigned char * p = *(unsigned char * const *)a, * q = *(unsigned char * const *)b;
+  int i;
+
+  for (i = 1; p[i] && p[i] == q[i]; ++i);
+  return (p[i] ? p[i] : p[0] ? JB_PATH_SEPARATOR : 0) - (q[i] ? q[i] : q[0] ? JB_PATH_SEPARATOR : 0);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Add a file to a batch of files to be deleted.
+ *   batch:  batch of files to be deleted
+ *   name:  filename (without path)
+ */
+void delete_batch_add(struct delete_batch * batch, const char * name)
+{
+  size_t n = strlen(name) + 1;
+
+  /* If necessary, allocate memory for more items (doubling the number allocated each time). */
+  if (batch->count == batch->size)
+  {
+    batch->size = batch->size ? 2 * batch->size : 16;
+    batch->names = (char **)realloc(batch->names, batch->size * sizeof(char *));
+    batch->failed = (char *)realloc(batch->failed, batch->size);
+  }
+
+  /* Allocate memory for a new string and copy the filename into it. */
+  memcpy((batch->names[batch->count] = (char *)malloc(n)), name, n);
+  batch->failed[batch->count++] = 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Free the memory allocated for a batch of files to be deleted.
+ *   batch:  batch of files to be deleted
+ */
+void delete_batch_free(struct delete_batch * batch)
+{
+  int i;
+
+  for (i = 0; i < batch->count; ++i) free(batch->names[i]);
+  free(batch->names);
+  free(batch->failed);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Delete a file in a batch (as a work_function, so that worker threads can share the batch).
+ *   context:  batch of files to be deleted
+ *   index:  index of file in batch
+ */
+void delete_file(void * context, int index)
+{
+  struct delete_batch * batch = (struct delete_batch *)context;
+#ifdef _WIN32
+  char s[JB_PATH_MAX_LENGTH];
+#endif
+
+  pressure_check();
+  tune_check();
+  limit_take(&operations, 1);
+#ifdef _WIN32
+  path_build(s, batch->dir, batch->names[index]);
+  if (remove(s)) { perror("remove"); batch->failed[index] = 1; }
+#else
+  if (unlinkat(batch->dir, batch->names[index], 0)) { perror("unlinkat"); batch->failed[index] = 1; }
+#endif
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Delete an (empty) directory in a batch.
+ *   batch:  batch of directories to be deleted
+ *   index:  index of directory in batch
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int delete_directory(struct delete_batch * batch, int index)
+{
+#ifdef _WIN32
+  char s[JB_PATH_MAX_LENGTH];
+#endif
+
+  limit_take(&operations, 1);
+#ifdef _WIN32
+  path_build(s, batch->dir, batch->names[index]);
+  if (_rmdir(s)) { perror("_rmdir"); return batch->failed[index] = 1; }
+#else
+  if (unlinkat(batch->dir, batch->names[index], AT_REMOVEDIR)) { perror("unlinkat"); return batch->failed[index] = 1; }
+#endif
+  return 0;
 }
@@ -0,0 +1,247 @@
+/* pressure.c - pressure stall functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* Linux reports how much of the time tasks have been stalled waiting for I/O and for memory (pressure stall information,
+ * or PSI) in /proc/pressure, and likewise for each cgroup (in cgroup v2).  While a sync is running, this is sampled every
+ * PRESSURE_INTERVAL.  Whenever the fraction of the time that some task was stalled (on either resource) rises above
+ * PRESSURE_HIGH, the number of threads doing the work and the rates at which bytes are copied and I/O operations are done
+ * are cut in half.  Whenever it falls below PRESSURE_LOW, they are raised again (the threads one at a time, and the rates by
+ * a quarter), up to what was specified on the command line.  (If no rate was specified, the rate at which the sync was going
+ * when the pressure rose is used instead, and the limit is lifted again once the sync no longer comes near it.)  Thus, the
+ * sync soaks up capacity that would otherwise be idle, without hurting the latency of whatever else is running.
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#ifdef _WIN32
+/* This eliminates deprecation warnings for functions that are considered "unsafe" (and would
+ * result in error C4996) on Win32, thus allowing us to write simpler, more portable code.
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#  include <windows.h>  /* InterlockedCompareExchange64 */
+#endif
+
+#include <stdio.h>     /* fclose, fgets, FILE, fopen, fprintf, sprintf, sscanf, stderr */
+#include <string.h>    /* strlen, strncmp, strstr */
+#include "jb.h"        /* JB_PATH_MAX_LENGTH, jb_trim */
+#include "limit.h"     /* (struct) limit, limit_clock, limit_rate, limit_set */
+#include "pressure.h"  /* PRESSURE_HIGH, PRESSURE_INTERVAL, PRESSURE_LOW */
+#include "work.h"      /* work_limit, WORK_LIMIT_PRESSURE */
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Portable atomic compare-and-swap (of a 64-bit integer) */
+#ifdef _WIN32
+#  define ATOMIC_SWAP(p, old, new)  (InterlockedCompareExchange64((p), (new), (old)) == (old))
+#else
+#  define ATOMIC_SWAP(p, old, new)  __sync_bool_compare_and_swap((p), (old), (new))
+#endif
+
+/* Number of resources (I/O and memory) for which pressure is sampled */
+#define RESOURCE_COUNT 2
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Limit adjusted according to pressure */
+struct pressure_limit
+{
+  struct limit * limit;  /* limit */
+  double base;           /* rate specified on the command line (or zero, if none) */
+  double peak;           /* highest rate observed so far */
+  long long total;       /* number of units consumed as of the last sample */
+};
+
+
+/*************
+ * Constants *
+ *************/
+
+static const char * RESOURCES[RESOURCE_COUNT] = { "io", "memory" };
+static const char * STR_UNAVAILABLE = "Pressure stall information is not available.\n";
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+int pressure_find(int i);
+int pressure_read(const char * path, long long * total_ptr);
+void pressure_adapt(struct pressure_limit * p, double seconds, int direction);
+
+
+/*********************
+ * Private Variables *
+ *********************/
+
+/* State of the sampling (started by pressure_start) */
+static struct
+{
+  char paths[RESOURCE_COUNT][JB_PATH_MAX_LENGTH];  /* pathnames of pressure files */
+  long long stalls[RESOURCE_COUNT];                /* total time (in microseconds) stalled on each resource, as of the last sample */
+  volatile long long next;                         /* time (in nanoseconds) at which to take the next sample */
+  long long last;                                  /* time (in nanoseconds) at which the last sample was taken */
+  int jobs;                                        /* number of threads allowed to work (or zero, if not started) */
+  int max_jobs;                                    /* number of threads specified on the command line */
+  struct pressure_limit limits[2];                 /* bandwidth and I/O operation limits */
+} state;
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Start sampling pressure (and adjusting the number of threads and limits accordingly).
+ *   jobs:  number of threads specified on the command line (see work_start)
+ *   bandwidth:  limit on the number of bytes copied per second
+ *   operations:  limit on the number of I/O operations done per second
+ * Return Value:  Zero on success; otherwise (e.g., if there is no pressure stall information), nonzero.
+ */
+int pressure_start(int jobs, struct limit * bandwidth, struct limit * operations)
+{
+  int i;
+
+  for (i = 0; i < RESOURCE_COUNT; ++i) if (pressure_find(i)) { fprintf(stderr, STR_UNAVAILABLE); return -1; }
+  state.limits[0].limit = bandwidth;
+  state.limits[1].limit = operations;
+  for (i = 0; i < 2; ++i)
+  {
+    state.limits[i].base = limit_rate(state.limits[i].limit);
+    state.limits[i].peak = 0;
+    state.limits[i].total = state.limits[i].limit->total;
+  }
+  state.last = limit_clock();
+  state.next = state.last + PRESSURE_INTERVAL;
+  state.jobs = state.max_jobs = jobs;
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * If it is time, sample pressure (and adjust the number of threads and limits accordingly).  This is meant to be called
+ * often, by any thread; it does nothing (but check the time) unless sampling was started, and it is time for a sample,
+ * and no other thread has beaten this one to it.
+ */
+void pressure_check(void)
+{
+  long long now, next, t;
+  double x, y = 0;
+  int i, d;
+
+  /* Make sure that it is time to take a sample (and that this is the only thread to take it). */
+  if (!state.jobs || (now = limit_clock()) < (next = state.next) || !ATOMIC_SWAP(&state.next, next, now + PRESSURE_INTERVAL)) return;
+
+  /* Determine the fraction of the time since the last sample that some task was stalled (on whichever resource is worse). */
+  for (i = 0; i < RESOURCE_COUNT; ++i)
+  {
+    if (pressure_read(state.paths[i], &t)) continue;
+    if ((x = (t - state.stalls[i]) * 1000.0 / (now - state.last)) > y) y = x;
+    state.stalls[i] = t;
+  }
+  x = (now - state.last) / 1e9;
+  state.last = now;
+
+  /* Back off (or ramp back up), if necessary. */
+  d = (y > PRESSURE_HIGH) ? -1 : (y < PRESSURE_LOW) ? 1 : 0;
+  for (i = 0; i < 2; ++i) pressure_adapt(&state.limits[i], x, d);
+  i = (d < 0) ? (state.jobs + 1) / 2 : (d > 0 && state.jobs < state.max_jobs) ? state.jobs + 1 : state.jobs;
+  if (i != state.jobs) work_limit(WORK_LIMIT_PRESSURE, state.jobs = i);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Find the pressure file for a resource: system-wide if possible, or else for this process's cgroup.
+ *   i:  index of resource
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int pressure_find(int i)
+{
+  static const char * roots[] = { "/sys/fs/cgroup", "/sys/fs/cgroup/unified" };
+
+  char s[JB_PATH_MAX_LENGTH], * p = state.paths[i];
+  FILE * f;
+  int j;
+
+  sprintf(p, "/proc/pressure/%s", RESOURCES[i]);
+  if (!pressure_read(p, &state.stalls[i])) return 0;
+
+  /* Look for the (cgroup v2) entry "0::PATH" in /proc/self/cgroup. */
+  if (!(f = fopen("/proc/self/cgroup", "r"))) return -1;
+  while ((p = fgets(s, JB_PATH_MAX_LENGTH, f)) && strncmp(s, "0::", 3));
+  fclose(f);
+  if (!p || strlen(p = jb_trim(s + 3)) + 32 > JB_PATH_MAX_LENGTH) return -1;
+  for (j = 0; j < 2; ++j)
+  {
+    sprintf(state.paths[i], "%s%s/%s.pressure", roots[j], (*p == '/' && !p[1]) ? "" : p, RESOURCES[i]);
+    if (!pressure_read(state.paths[i], &state.stalls[i])) return 0;
+  }
+  return -1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Read the total time that some task was stalled on a resource from its pressure file
+ * (i.e., the "total" field of the line beginning with "some", e.g., "some avg10=... total=123").
+ *   path:  pathname of pressure file
+ *   total_ptr:  receives total time (in microseconds)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int pressure_read(const char * path, long long * total_ptr)
+{
+  char s[256], * p = NULL;
+  FILE * f;
+
+  if (!(f = fopen(path, "r"))) return -1;
+  while (fgets(s, sizeof(s), f)) if (!strncmp(s, "some ", 5) && (p = strstr(s, "total="))) break;
+  fclose(f);
+  return !p || sscanf(p + 6, "%lld", total_ptr) != 1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Adjust a limit according to pressure.
+ *   p:  limit
+ *   seconds:  time since the last sample
+ *   direction:  negative if the pressure is high (so the limit should be lowered), positive if it is low (so the limit
+ *     should be raised), or zero if neither (in which case the rate observed is merely noted)
+ */
+void pressure_adapt(struct pressure_limit * p, double seconds, int direction)
+{
+  long long total = p->limit->total;
+  double rate = limit_rate(p->limit), x = (total - p->total) / seconds;
+
+  p->total = total;
+  if (x > p->peak) p->peak = x;
+  if (direction < 0)
+  {
+    /* Halve the rate (or, if there is no limit yet, the rate observed), but not below a small fraction of the original. */
+    if ((rate = (rate ? rate : x) / 2) <= 0) return;
+    if ((x = (p->base ? p->base : p->peak) / 64) > rate) rate = x;
+  }
+  else if (direction > 0)
+  {
+    /* Raise the rate, but not above the rate specified.  (If none was specified, and the limit is no longer being
+     * approached, lift it.)
+     */
+    if (!rate) return;
+    rate *= 1.25;
+    if (p->base && rate > p->base) rate = p->base;
+    else if (!p->base && x < rate / 2) rate = 0;
+  }
+  else return;
+  limit_set(p->limit, rate);
+}
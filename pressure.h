@@ -0,0 +1,45 @@
+/* pressure.h - pressure stall functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _PRESSURE_H_
+#define _PRESSURE_H_
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include "limit.h"  /* (struct) limit */
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Time (in nanoseconds) between samples of pressure */
+#define PRESSURE_INTERVAL 1000000000LL  /* 1 second */
+
+/* Fraction of time stalled above which to back off, and below which to ramp back up */
+#define PRESSURE_HIGH 0.10
+#define PRESSURE_LOW  0.02
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+int pressure_start(int jobs, struct limit * bandwidth, struct limit * operations);
+void pressure_check(void);
+
+
+#endif  /* (prevent multiple inclusion) */
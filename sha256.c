@@ -0,0 +1,151 @@
+/* sha256.c - SHA-256 functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* SHA-256 (as specified in FIPS 180-4) is the hash written to manifests, so that they can be checked by sha256sum.
+ * Data is hashed as it is copied (one block of the copy at a time), so there is no need to read anything twice.
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include <stddef.h>    /* size_t */
+#include <string.h>    /* memcpy, memset */
+#include "sha256.h"    /* (struct) sha256, SHA256_SIZE */
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Operations on 32-bit words */
+#define ROTATE(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z)    (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z)   (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define SIGMA0(x)      (ROTATE((x), 2) ^ ROTATE((x), 13) ^ ROTATE((x), 22))
+#define SIGMA1(x)      (ROTATE((x), 6) ^ ROTATE((x), 11) ^ ROTATE((x), 25))
+#define GAMMA0(x)      (ROTATE((x), 7) ^ ROTATE((x), 18) ^ ((x) >> 3))
+#define GAMMA1(x)      (ROTATE((x), 17) ^ ROTATE((x), 19) ^ ((x) >> 10))
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+void sha256_block(struct sha256 * sha, const unsigned char * p);
+
+
+/*************
+ * Constants *
+ *************/
+
+/* Round constants (the first 32 bits of the fractional parts of the cube roots of the first 64 primes) */
+static const unsigned int K[64] =
+{
+  0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+  0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+  0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+  0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+  0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+  0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+  0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+  0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Begin a hash.
+ *   sha:  hash in progress
+ */
+void sha256_init(struct sha256 * sha)
+{
+  sha->state[0] = 0x6A09E667; sha->state[1] = 0xBB67AE85; sha->state[2] = 0x3C6EF372; sha->state[3] = 0xA54FF53A;
+  sha->state[4] = 0x510E527F; sha->state[5] = 0x9B05688C; sha->state[6] = 0x1F83D9AB; sha->state[7] = 0x5BE0CD19;
+  sha->length = 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Add data to a hash.
+ *   sha:  hash in progress
+ *   data:  data
+ *   size:  size (in bytes) of data
+ */
+void sha256_update(struct sha256 * sha, const void * data, size_t size)
+{
+  const unsigned char * p = (const unsigned char *)data;
+  size_t i = (size_t)(sha->length & 63), n;
+
+  sha->length += size;
+
+  /* Finish the current block, if there is one (and enough data to finish it). */
+  if (i)
+  {
+    memcpy(sha->block + i, p, n = (size < 64 - i) ? size : 64 - i);
+    if (i + n < 64) return;
+    sha256_block(sha, sha->block);
+    p += n; size -= n;
+  }
+
+  /* Hash each whole block in place, and save what is left over for next time. */
+  for (; size >= 64; p += 64, size -= 64) sha256_block(sha, p);
+  memcpy(sha->block, p, size);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Finish a hash.
+ *   sha:  hash in progress
+ *   hash:  receives hash (SHA256_SIZE bytes)
+ */
+void sha256_final(struct sha256 * sha, unsigned char * hash)
+{
+  unsigned long long n = sha->length * 8;
+  size_t i = (size_t)(sha->length & 63);
+  int j;
+
+  /* Pad the data with a one bit, then zeros (up to the last eight bytes of a block), then its length (in bits). */
+  sha->block[i++] = 0x80;
+  if (i > 56) { memset(sha->block + i, 0, 64 - i); sha256_block(sha, sha->block); i = 0; }
+  memset(sha->block + i, 0, 56 - i);
+  for (j = 0; j < 8; ++j) sha->block[63 - j] = (unsigned char)(n >> (8 * j));
+  sha256_block(sha, sha->block);
+
+  /* The hash is the final state (big-endian). */
+  for (j = 0; j < SHA256_SIZE; ++j) hash[j] = (unsigned char)(sha->state[j >> 2] >> (24 - 8 * (j & 3)));
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Hash one (64-byte) block.
+ *   sha:  hash in progress
+ *   p:  block
+ */
+void sha256_block(struct sha256 * sha, const unsigned char * p)
+{
+  unsigned int w[64], s[8], t, u;
+  int i;
+
+  for (i = 0; i < 16; ++i, p += 4) w[i] = (unsigned int)p[0] << 24 | (unsigned int)p[1] << 16 | (unsigned int)p[2] << 8 | p[3];
+  for (; i < 64; ++i) w[i] = GAMMA1(w[i - 2]) + w[i - 7] + GAMMA0(w[i - 15]) + w[i - 16];
+  memcpy(s, sha->state, sizeof(s));
+  for (i = 0; i < 64; ++i)
+  {
+    t = s[7] + SIGMA1(s[4]) + CH(s[4], s[5], s[6]) + K[i] + w[i];
+    u = SIGMA0(s[0]) + MAJ(s[0], s[1], s[2]);
+    s[7] = s[6]; s[6] = s[5]; s[5] = s[4]; s[4] = s[3] + t;
+    s[3] = s[2]; s[2] = s[1]; s[1] = s[0]; s[0] = t + u;
+  }
+  for (i = 0; i < 8; ++i) sha->state[i] += s[i];
+}
@@ -0,0 +1,55 @@
+/* sha256.h - SHA-256 functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include <stddef.h>  /* size_t */
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Size (in bytes) of a hash */
+#define SHA256_SIZE 32
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Hash in progress */
+struct sha256
+{
+  unsigned int state[8];         /* intermediate hash value */
+  unsigned long long length;     /* number of bytes hashed so far */
+  unsigned char block[64];       /* bytes of the current (incomplete) block */
+};
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+void sha256_init(struct sha256 * sha);
+void sha256_update(struct sha256 * sha, const void * data, size_t size);
+void sha256_final(struct sha256 * sha, unsigned char * hash);
+
+
+#endif  /* (prevent multiple inclusion) */
@@ -0,0 +1,318 @@
+/* share.c - shared work queue functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* A shared work queue lets several Plunge processes (perhaps running with different priorities, or in different cgroups)
+ * cooperate on one job.  The coordinator puts the relative pathnames of the files to sync into a shared memory segment,
+ * along with a cursor.  Each process (the coordinator included) then repeatedly claims the next batch of pathnames by
+ * atomically advancing the cursor, so that faster processes simply end up doing more of the work.  Each process keeps its
+ * statistics in the segment too, so that the coordinator can report them all once everyone has finished.  Each process
+ * also notes the batch it is working on, so that if it exits without finishing, the coordinator can redo that batch.
+ *
+ * The coordinator cannot wait for the other processes to exit (they are not its children), so it waits on a semaphore that
+ * each posts once it has finished.  A process that exits without finishing never posts, so the wait times out every second
+ * to check whether each unfinished process still exists.
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#ifndef _WIN32
+#  include <sys/mman.h>  /* MAP_FAILED, MAP_SHARED, mmap, munmap, PROT_READ, PROT_WRITE, shm_open, shm_unlink */
+#  include <sys/stat.h>  /* fstat, (struct) stat */
+#  include <fcntl.h>     /* O_CREAT, O_EXCL, O_RDWR */
+#  include <semaphore.h> /* sem_init, sem_post, sem_t, sem_timedwait */
+#  include <signal.h>    /* kill */
+#  include <unistd.h>    /* close, ftruncate, getpid */
+#endif
+#include <errno.h>       /* EINTR, ENOSYS, errno, ESRCH */
+#include <stdio.h>       /* fprintf, perror, stderr */
+#include <stdlib.h>      /* free, malloc */
+#include <string.h>      /* memcmp, memcpy, memset, strlen */
+#include <time.h>        /* clock_gettime, CLOCK_REALTIME, (struct) timespec */
+#include "jb.h"          /* JB_PATH_MAX_LENGTH */
+#include "share.h"       /* (struct) share, (struct) share_stats, SHARE_BATCH_SIZE, SHARE_MAX_WORKERS */
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Beginning of shared memory segment (followed by the offset of each pathname, and then the pathnames themselves) */
+struct share_header
+{
+  char signature[8];                                /* identifies the segment as a Plunge work queue */
+  int path_count;                                   /* number of pathnames */
+  volatile int cursor;                              /* index of next pathname to be claimed */
+  volatile int worker_count;                        /* number of processes that have attached (including the coordinator) */
+#ifndef _WIN32
+  sem_t finished;                                   /* posted by each worker once it has finished */
+#endif
+  struct share_stats workers[SHARE_MAX_WORKERS];    /* statistics for each process (in use if pid is nonzero) */
+};
+
+
+/*************
+ * Constants *
+ *************/
+
+static const char SIGNATURE[8] = { 'P', 'L', 'U', 'N', 'G', 'E', 'Q', '1' };
+static const char * STR_INVALID_FORMAT = "%s: not a Plunge work queue\n";
+static const char * STR_TOO_MANY_FORMAT = "%s: too many workers\n";
+static const char * STR_GONE_FORMAT = "Worker %d (PID %ld) exited without finishing.\n";
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+void share_name(char * s, const char * name);
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Create a shared work queue (as the coordinator).
+ *   name:  name of shared memory segment
+ *   paths:  relative pathnames of files to sync
+ *   path_count:  number of pathnames in paths
+ * Return Value:  On success, the work queue (which should be closed with share_close).  Otherwise, NULL.
+ */
+struct share * share_create(const char * name, char ** paths, int path_count)
+{
+#ifdef _WIN32
+  errno = ENOSYS; perror("shm_open"); return NULL;
+#else
+  struct share * share;
+  struct share_header * h;
+  size_t i, n, size = sizeof(struct share_header) + path_count * sizeof(int);
+  int * offsets, fd;
+  char * p;
+
+  /* Determine the size of the segment (header, offsets, and pathnames). */
+  for (i = 0; i < (size_t)path_count; ++i) size += strlen(paths[i]) + 1;
+
+  /* Create the segment (which must not already exist) and map it into memory. */
+  if (!(share = (struct share *)malloc(sizeof(struct share)))) { perror("malloc"); return NULL; }
+  share_name(share->name, name);
+  if ((fd = shm_open(share->name, O_CREAT | O_EXCL | O_RDWR, 0600)) < 0) { perror("shm_open"); free(share); return NULL; }
+  if (ftruncate(fd, size)) { perror("ftruncate"); close(fd); shm_unlink(share->name); free(share); return NULL; }
+  h = (struct share_header *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (h == MAP_FAILED) { perror("mmap"); shm_unlink(share->name); free(share); return NULL; }
+
+  /* Copy the pathnames into the segment. */
+  offsets = (int *)(h + 1);
+  p = (char *)(offsets + path_count);
+  for (i = 0; i < (size_t)path_count; ++i)
+  {
+    offsets[i] = (int)(p - (char *)h);
+    memcpy(p, paths[i], n = strlen(paths[i]) + 1);
+    p += n;
+  }
+
+  /* Initialize the header.  (The coordinator is the first worker.)  The signature goes in last, to mark the segment ready. */
+  h->path_count = path_count;
+  h->cursor = 0;
+  h->worker_count = 1;
+  memset(h->workers, 0, sizeof(h->workers));
+  h->workers[0].pid = (long)getpid();
+  if (sem_init(&h->finished, 1, 0))
+  {
+    perror("sem_init"); munmap(h, size); shm_unlink(share->name); free(share); return NULL;
+  }
+  __sync_synchronize();
+  memcpy(h->signature, SIGNATURE, sizeof(SIGNATURE));
+
+  share->header = h;
+  share->size = size;
+  share->slot = 0;
+  share->owner = 1;
+  return share;
+#endif
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Attach to a shared work queue (as a worker).
+ *   name:  name of shared memory segment (created by the coordinator)
+ * Return Value:  On success, the work queue (which should be closed with share_close).  Otherwise, NULL.
+ */
+struct share * share_attach(const char * name)
+{
+#ifdef _WIN32
+  errno = ENOSYS; perror("shm_open"); return NULL;
+#else
+  struct share * share;
+  struct share_header * h;
+  struct stat st;
+  long pid = (long)getpid();
+  int fd, i, n;
+
+  /* Open the segment and map it into memory. */
+  if (!(share = (struct share *)malloc(sizeof(struct share)))) { perror("malloc"); return NULL; }
+  share_name(share->name, name);
+  if ((fd = shm_open(share->name, O_RDWR, 0)) < 0) { perror("shm_open"); free(share); return NULL; }
+  if (fstat(fd, &st)) { perror("fstat"); close(fd); free(share); return NULL; }
+  if ((size_t)st.st_size < sizeof(struct share_header)) { fprintf(stderr, STR_INVALID_FORMAT, name); close(fd); free(share); return NULL; }
+  h = (struct share_header *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (h == MAP_FAILED) { perror("mmap"); free(share); return NULL; }
+  share->header = h;
+  share->size = st.st_size;
+  share->owner = 0;
+
+  /* Make sure that the segment is a (ready) work queue, and claim a slot for our statistics by putting our process ID in it.
+   * (So the coordinator never sees a slot in use without knowing which process to check on; see share_finish.)
+   */
+  if (memcmp(h->signature, SIGNATURE, sizeof(SIGNATURE))) { fprintf(stderr, STR_INVALID_FORMAT, name); share_close(share); return NULL; }
+  for (i = 1; i < SHARE_MAX_WORKERS && !__sync_bool_compare_and_swap(&h->workers[i].pid, 0, pid); ++i);
+  if (i == SHARE_MAX_WORKERS) { fprintf(stderr, STR_TOO_MANY_FORMAT, name); share_close(share); return NULL; }
+  while ((n = h->worker_count) <= i && !__sync_bool_compare_and_swap(&h->worker_count, n, i + 1));
+  share->slot = i;
+  return share;
+#endif
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Claim the next batch of pathnames from a shared work queue.  (The batch is noted before it is claimed, so that if this
+ * process exits at any point while working on it, the coordinator redoes it, even if that means doing it twice.)  Once
+ * there are none left, the coordinator claims the batch of each worker that exited without finishing, one at a time.
+ *   share:  work queue
+ *   index_ptr:  receives index of first pathname in batch
+ * Return Value:  Number of pathnames in batch (or zero, if there are none left).
+ */
+int share_claim(struct share * share, int * index_ptr)
+{
+#ifdef _WIN32
+  return 0;
+#else
+  struct share_header * h = share->header;
+  struct share_stats * stats = &h->workers[share->slot];
+  int i, k, n = h->path_count;
+
+  /* (Don't advance the cursor past the end, so that it can't wrap around no matter how many times it is claimed.) */
+  for (;;)
+  {
+    if ((i = h->cursor) >= n) break;
+    stats->claimed = i;
+    stats->claim_count = k = (n - i > SHARE_BATCH_SIZE) ? SHARE_BATCH_SIZE : n - i;
+    __sync_synchronize();
+    if (__sync_bool_compare_and_swap(&h->cursor, i, i + k)) { *index_ptr = i; return k; }
+  }
+  stats->claim_count = 0;
+  if (!share->owner) return 0;
+
+  /* Take over the batch of a worker that exited without finishing (see share_finish). */
+  n = (h->worker_count < SHARE_MAX_WORKERS) ? h->worker_count : SHARE_MAX_WORKERS;
+  for (i = 1; i < n; ++i)
+  {
+    if (h->workers[i].done >= 0 || !(k = h->workers[i].claim_count)) continue;
+    h->workers[i].claim_count = 0;
+    *index_ptr = h->workers[i].claimed;
+    return k;
+  }
+  return 0;
+#endif
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Get a pathname from a shared work queue.
+ *   share:  work queue
+ *   index:  index of pathname
+ * Return Value:  Relative pathname of file (in the shared memory segment).
+ */
+const char * share_path(struct share * share, int index)
+{
+  return (const char *)share->header + ((int *)(share->header + 1))[index];
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Get the statistics for a worker from a shared work queue.
+ *   share:  work queue
+ *   slot:  index of worker (or, if negative, this process)
+ * Return Value:  Statistics (in the shared memory segment).
+ */
+struct share_stats * share_stats(struct share * share, int slot)
+{
+  return &share->header->workers[(slot < 0) ? share->slot : slot];
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Finish with a shared work queue (i.e., once there are no pathnames left to claim).  If this process is
+ * the coordinator, wait for the others to finish too (or to exit without finishing, in which case say so,
+ * and claim their batches to redo them; see share_claim).
+ *   share:  work queue
+ * Return Value:  Number of workers (including the coordinator) that have attached to the work queue.
+ */
+int share_finish(struct share * share)
+{
+#ifdef _WIN32
+  return 0;
+#else
+  struct share_header * h = share->header;
+  struct timespec ts;
+  int i, k, n;
+
+  h->workers[share->slot].done = 1;
+  if (!share->owner) { sem_post(&h->finished); return h->worker_count; }
+
+  /* Wait for each worker to finish.  (If a worker process no longer exists, it is not going to.  Any other error from kill,
+   * such as EPERM, means that it does exist.)
+   */
+  for (;;)
+  {
+    n = (h->worker_count < SHARE_MAX_WORKERS) ? h->worker_count : SHARE_MAX_WORKERS;
+    for (i = 1, k = 0; i < n; ++i)
+    {
+      if (h->workers[i].done) continue;
+      if (!kill((pid_t)h->workers[i].pid, 0) || errno != ESRCH) { ++k; continue; }
+      fprintf(stderr, STR_GONE_FORMAT, i + 1, h->workers[i].pid);
+      h->workers[i].done = -1;
+    }
+    if (!k) return n;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 1;
+    while (sem_timedwait(&h->finished, &ts) && errno == EINTR);
+  }
+#endif
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Close a shared work queue.  (If this process is the coordinator, the shared memory segment is removed as well.)
+ *   share:  work queue
+ */
+void share_close(struct share * share)
+{
+#ifndef _WIN32
+  munmap(share->header, share->size);
+  if (share->owner && shm_unlink(share->name)) perror("shm_unlink");
+#endif
+  free(share);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Build the name of a shared memory segment (which must begin with a slash).
+ *   s:  receives name of segment
+ *   name:  name specified on the command line
+ */
+void share_name(char * s, const char * name)
+{
+  size_t n = strlen(name);
+
+  if (n > JB_PATH_MAX_LENGTH - 2) n = JB_PATH_MAX_LENGTH - 2;
+  if (*name != '/') *s++ = '/';
+  memcpy(s, name, n);
+  s[n] = '\0';
+}
@@ -0,0 +1,74 @@
+/* share.h - shared work queue functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _SHARE_H_
+#define _SHARE_H_
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include <stddef.h>  /* size_t */
+#include "jb.h"      /* JB_PATH_MAX_LENGTH */
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+#define SHARE_MAX_WORKERS 64
+#define SHARE_BATCH_SIZE  64
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Statistics for one worker process (kept in shared memory, so that the coordinator can report them all) */
+struct share_stats
+{
+  long pid;            /* process ID */
+  long long files;     /* number of files compared */
+  long long copies;    /* number of files copied */
+  long long bytes;     /* number of bytes copied (i.e., read from source files) */
+  long long errors;    /* number of errors */
+  int done;            /* positive once the worker has finished (negative if it exited without finishing) */
+  int claimed;         /* index of the first pathname in the batch the worker is claiming or has claimed */
+  int claim_count;     /* number of pathnames in that batch (or zero, if none; see share_claim) */
+};
+
+struct share
+{
+  struct share_header * header;  /* shared memory segment */
+  size_t size;                   /* size (in bytes) of segment */
+  int slot;                      /* index of this process's statistics in segment */
+  int owner;                     /* nonzero if this process (the coordinator) created the segment */
+  char name[JB_PATH_MAX_LENGTH]; /* name of segment */
+};
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+struct share * share_create(const char * name, char ** paths, int path_count);
+struct share * share_attach(const char * name);
+int share_claim(struct share * share, int * index_ptr);
+const char * share_path(struct share * share, int index);
+struct share_stats * share_stats(struct share * share, int slot);
+int share_finish(struct share * share);
+void share_close(struct share * share);
+
+
+#endif  /* (prevent multiple inclusion) */
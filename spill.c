@@ -0,0 +1,279 @@
+/* spill.c - spill functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* When more files are input than fit in the memory allowed (see --memory), they are spilled to disk: each time the files
+ * input so far take up the memory, they are sorted by pathname and written to a temporary file as a run (and freed).
+ * The runs are then merged (k ways, by way of a heap of the next file of each), so that the files can be got back in
+ * sorted order, a few at a time, holding only one file of each run in memory.  Each file in a run is written like one
+ * in a plan (see plan.c): the length of the prefix its pathname shares with the previous one and the length of the rest
+ * of it (as variable-length integers), followed by the rest of it, and then its size, its modification time (zigzag-
+ * encoded), and the nanoseconds part of that plus one (or zero, if its size and time were not input).
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#ifdef _WIN32
+/* This eliminates deprecation warnings for functions that are considered "unsafe" (and would
+ * result in error C4996) on Win32, thus allowing us to write simpler, more portable code.
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <stddef.h>  /* size_t */
+#include <stdio.h>   /* fclose, FILE, fread, fwrite, perror, rewind, tmpfile */
+#include <stdlib.h>  /* calloc, free, malloc, qsort, realloc */
+#include <string.h>  /* memcpy, strcmp, strlen, strncmp */
+#include <time.h>    /* time_t */
+#include "jb.h"      /* jb_file_get_varint, jb_file_put_varint, JB_PATH_MAX_LENGTH */
+#include "spill.h"   /* (struct) spill, (struct) spill_run */
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+int spill_read(struct spill_run * run);
+void spill_sift(struct spill * spill, int index);
+int compare_spilled_paths(const void * a, const void * b);
+
+
+/*********************
+ * Private Variables *
+ *********************/
+
+/* Pathnames being sorted (see compare_spilled_paths) */
+static char ** spilled_paths;
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Create a spill (with no runs yet).
+ * Return Value:  On success, the spill (which should be closed with spill_close).  Otherwise, NULL.
+ */
+struct spill * spill_create(void)
+{
+  struct spill * spill;
+
+  if (!(spill = (struct spill *)calloc(1, sizeof(struct spill)))) perror("calloc");
+  return spill;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Write files to a spill, as a new run (in sorted order).
+ *   spill:  spill (created by spill_create)
+ *   paths:  relative pathname of each file
+ *   sizes:  size (in bytes) of each file
+ *   mtimes:  modification time of each file
+ *   nsecs:  nanoseconds part of the modification time of each file (or, if its size and time were not input, negative)
+ *   count:  number of files
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int spill_put(struct spill * spill, char ** paths, const size_t * sizes, const time_t * mtimes, const long * nsecs,
+              int count)
+{
+  struct spill_run * run;
+  const char * last = "", * p;
+  size_t i, n;
+  long long t;
+  int * a, j, k;
+
+  /* Allocate memory for another run (and for its place in the heap), and create its temporary file. */
+  if (!(run = (struct spill_run *)realloc(spill->runs, (spill->run_count + 1) * sizeof(struct spill_run))))
+  {
+    perror("realloc"); return -1;
+  }
+  spill->runs = run;
+  if (!(a = (int *)realloc(spill->heap, (spill->run_count + 1) * sizeof(int)))) { perror("realloc"); return -1; }
+  spill->heap = a;
+  run = &spill->runs[spill->run_count];
+  if (!(run->file = tmpfile())) { perror("tmpfile"); return -1; }
+  run->count = run->left = 0;
+  ++spill->run_count;
+
+  /* Sort the files by pathname. */
+  if (!(a = (int *)malloc((count + 1) * sizeof(int)))) { perror("malloc"); return -1; }
+  for (j = 0; j < count; ++j) a[j] = j;
+  spilled_paths = paths;
+  qsort(a, count, sizeof(int), compare_spilled_paths);
+
+  /* Write each file (only the part of its pathname that is not the same as the previous one, etc.). */
+  for (j = 0; j < count; last = p, ++j)
+  {
+    p = paths[k = a[j]];
+    n = strlen(p);
+    t = mtimes[k];
+    for (i = 0; p[i] && p[i] == last[i]; ++i);
+    if (jb_file_put_varint(run->file, i) || jb_file_put_varint(run->file, n - i) ||
+        fwrite(p + i, 1, n - i, run->file) < n - i || jb_file_put_varint(run->file, sizes[k]) ||
+        jb_file_put_varint(run->file, ((unsigned long long)t << 1) ^ (t >> 63)) ||
+        jb_file_put_varint(run->file, nsecs[k] < 0 ? 0 : (unsigned long long)nsecs[k] + 1))
+    {
+      perror("fwrite"); free(a); return -1;
+    }
+  }
+  run->count = count;
+  free(a);
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Go back to the beginning of a spill (so that its files can be got, or found, in sorted order).
+ *   spill:  spill (created by spill_create)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int spill_rewind(struct spill * spill)
+{
+  struct spill_run * run;
+  int i;
+
+  /* Read the first file of each run, and make a heap of the runs (by the pathnames of those files). */
+  for (spill->heap_count = i = 0; i < spill->run_count; ++i)
+  {
+    run = &spill->runs[i];
+    if (fflush(run->file)) { perror("fflush"); return -1; }
+    rewind(run->file);
+    run->path[0] = '\0';
+    run->left = run->count;
+    if (!spill_read(run)) spill->heap[spill->heap_count++] = i;
+    else if (run->left >= 0) return -1;
+  }
+  for (i = spill->heap_count / 2; i > 0; --i) spill_sift(spill, i - 1);
+  spill->state = 0;
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Get the next file from a spill (in sorted order, across all of its runs).
+ *   spill:  spill (rewound by spill_rewind)
+ *   path:  receives relative pathname of file
+ *   size_ptr:  receives size (in bytes) of file
+ *   mtime_ptr:  receives modification time of file
+ *   nsec_ptr:  receives nanoseconds part of the modification time of file (or, if its size and time were not input, -1)
+ * Return Value:  If a file was got, positive.  Otherwise, zero if there are no more files, or negative if an error occurred.
+ */
+int spill_get(struct spill * spill, char * path, size_t * size_ptr, time_t * mtime_ptr, long * nsec_ptr)
+{
+  struct spill_run * run;
+
+  if (!spill->heap_count) return 0;
+
+  /* The next file is the one at the top of the heap.  Replace it with the next file of its run (if any). */
+  run = &spill->runs[spill->heap[0]];
+  memcpy(path, run->path, strlen(run->path) + 1);
+  *size_ptr = run->size;
+  *mtime_ptr = run->mtime;
+  *nsec_ptr = run->nsec;
+  if (spill_read(run))
+  {
+    if (run->left < 0) return -1;
+    spill->heap[0] = spill->heap[--spill->heap_count];
+  }
+  spill_sift(spill, 0);
+  return 1;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Determine whether or not a pathname is among the files of a spill.  Since the files are got in sorted order, this is a
+ * merge join: the pathnames must be looked up in sorted order too (from the time the spill is rewound), so that no file is
+ * got more than once.  (If an error occurs, it is reported, and there are taken to be no more files.)
+ *   spill:  spill (rewound by spill_rewind)
+ *   path:  relative pathname (not sorting before any looked up since the spill was rewound)
+ *   prefix:  nonzero if any pathname that begins with path counts; otherwise, zero (if only path itself counts)
+ * Return Value:  Nonzero if the pathname is in the spill; otherwise, zero.
+ */
+int spill_find(struct spill * spill, const char * path, int prefix)
+{
+  size_t size;
+  time_t mtime;
+  long nsec;
+
+  /* Get files up to the first that does not sort before the pathname. */
+  while (spill->state >= 0 && (!spill->state || strcmp(spill->found, path) < 0))
+  {
+    spill->state = (spill_get(spill, spill->found, &size, &mtime, &nsec) > 0) ? 1 : -1;
+  }
+  if (spill->state < 0) return 0;
+  return prefix ? !strncmp(spill->found, path, strlen(path)) : !strcmp(spill->found, path);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Close a spill (deleting its temporary files), and free the memory allocated for it.
+ *   spill:  spill (created by spill_create)
+ */
+void spill_close(struct spill * spill)
+{
+  int i;
+
+  for (i = 0; i < spill->run_count; ++i) fclose(spill->runs[i].file);
+  free(spill->runs);
+  free(spill->heap);
+  free(spill);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Read the next file of a run.
+ *   run:  run
+ * Return Value:  Zero on success.  Otherwise, nonzero (and if an error occurred, it is reported, and run->left is negative).
+ */
+int spill_read(struct spill_run * run)
+{
+  unsigned long long i, n, z, t, x;
+
+  if (run->left <= 0) return -1;
+  if (jb_file_get_varint(run->file, &i) || jb_file_get_varint(run->file, &n) ||
+      i > strlen(run->path) || (n += i) >= JB_PATH_MAX_LENGTH || fread(run->path + i, 1, n - i, run->file) < n - i ||
+      jb_file_get_varint(run->file, &z) || jb_file_get_varint(run->file, &t) || jb_file_get_varint(run->file, &x))
+  {
+    perror("fread"); run->left = -1; return -1;
+  }
+  run->path[n] = '\0';
+  run->size = (size_t)z;
+  run->mtime = (time_t)((long long)(t >> 1) ^ -(long long)(t & 1));
+  run->nsec = (long)x - 1;
+  --run->left;
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Move a run down the heap of a spill, to where it belongs (below the runs whose next files sort before its own).
+ *   spill:  spill
+ *   index:  index into heap of run
+ */
+void spill_sift(struct spill * spill, int index)
+{
+  int i = index, j, k, * h = spill->heap;
+
+  for (; (j = 2 * i + 1) < spill->heap_count; i = j)
+  {
+    if (j + 1 < spill->heap_count && strcmp(spill->runs[h[j + 1]].path, spill->runs[h[j]].path) < 0) ++j;
+    if (strcmp(spill->runs[h[j]].path, spill->runs[h[i]].path) >= 0) break;
+    k = h[i]; h[i] = h[j]; h[j] = k;
+  }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Compare the pathnames of two files being spilled (by their indices, as the comparison function for qsort).
+ *   a:  pointer to index of first file
+ *   b:  pointer to index of second file
+ * Return Value:  Negative, zero, or positive, depending on whether the first file sorts before, the same as, or after the
+ *   second.
+ */
+int compare_spilled_paths(const void * a, const void * b)
+{
+  return strcmp(spilled_paths[*(const int *)a], spilled_paths[*(const int *)b]);
+}
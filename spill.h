@@ -0,0 +1,71 @@
+/* spill.h - spill functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _SPILL_H_
+#define _SPILL_H_
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include <stddef.h>  /* size_t */
+#include <stdio.h>   /* FILE */
+#include <time.h>    /* time_t */
+#include "jb.h"      /* JB_PATH_MAX_LENGTH */
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Sorted run of files in a temporary file */
+struct spill_run
+{
+  FILE * file;                    /* temporary file */
+  int count;                      /* number of files in the run */
+  int left;                       /* number of files yet to be read from it */
+  char path[JB_PATH_MAX_LENGTH];  /* relative pathname of the file read most recently */
+  size_t size;                    /* size (in bytes) of that file */
+  time_t mtime;                   /* modification time of that file */
+  long nsec;                      /* nanoseconds part of that (or, if its size and time were not input, negative) */
+};
+
+/* Files input, spilled to disk (in sorted runs) to save memory */
+struct spill
+{
+  struct spill_run * runs;        /* runs */
+  int run_count;                  /* number of runs */
+  int * heap;                     /* indices of the runs with a file read but not yet got (as a heap, ordered by pathname) */
+  int heap_count;                 /* number of items in heap */
+  char found[JB_PATH_MAX_LENGTH]; /* relative pathname of the file got most recently by spill_find */
+  int state;                      /* state of found: zero if nothing has been got yet, positive if it is valid, or negative
+                                   * if there was nothing left to get
+                                   */
+};
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+struct spill * spill_create(void);
+int spill_put(struct spill * spill, char ** paths, const size_t * sizes, const time_t * mtimes, const long * nsecs,
+              int count);
+int spill_rewind(struct spill * spill);
+int spill_get(struct spill * spill, char * path, size_t * size_ptr, time_t * mtime_ptr, long * nsec_ptr);
+int spill_find(struct spill * spill, const char * path, int prefix);
+void spill_close(struct spill * spill);
+
+
+#endif  /* (prevent multiple inclusion) */
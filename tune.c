@@ -0,0 +1,154 @@
+/* tune.c - concurrency tuning functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+/* The best number of threads depends on where the files are (a local SSD wants many, a spinning disk few, and a network
+ * mount, whose latency must be hidden, many again), and on what is being done with them (comparing them is bound by the
+ * speed of metadata operations; copying them, by bandwidth).  So rather than relying on --jobs, the number of threads can
+ * be tuned as the sync runs, separately for each phase, by sampling its throughput (I/O operations per second while
+ * comparing or deleting files, or bytes per second while copying them) every TUNE_INTERVAL:
+ *   - Whenever throughput improves significantly, another thread is added (additive increase).
+ *   - Whenever a thread was just added and throughput did not improve, that thread is taken away again.
+ *   - Whenever throughput falls significantly (other than that), a quarter of the threads are taken away (multiplicative
+ *     decrease), since the system is evidently overloaded.
+ *   - Whenever throughput holds steady for TUNE_PROBE samples, another thread is added, to see whether it helps.
+ * Thus, the number of threads hovers around the number that gives the most throughput (in each phase).
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#ifdef _WIN32
+#  include <windows.h>  /* InterlockedCompareExchange64 */
+#endif
+#include "limit.h"      /* (struct) limit, limit_clock */
+#include "tune.h"       /* (struct) tuning, TUNE_* */
+#include "work.h"       /* work_limit, WORK_LIMIT_TUNE */
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Portable atomic compare-and-swap (of a 64-bit integer) */
+#ifdef _WIN32
+#  define ATOMIC_SWAP(p, old, new)  (InterlockedCompareExchange64((p), (new), (old)) == (old))
+#else
+#  define ATOMIC_SWAP(p, old, new)  __sync_bool_compare_and_swap((p), (old), (new))
+#endif
+
+
+/*********************
+ * Private Variables *
+ *********************/
+
+/* State of the tuning (started by tune_start) */
+static struct
+{
+  int max_jobs;                                /* number of threads started (or zero, if not tuning) */
+  struct limit * counters[TUNE_PHASE_COUNT];   /* counter of throughput (units consumed) for each phase */
+  struct tuning phases[TUNE_PHASE_COUNT];      /* tuning of each phase */
+  int phase;                                   /* current phase */
+  volatile long long next;                     /* time (in nanoseconds) at which to take the next sample */
+  long long last;                              /* time (in nanoseconds) at which the last sample was taken */
+  long long total;                             /* number of units counted as of the last sample */
+} state;
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Start tuning the number of threads.
+ *   max_jobs:  number of threads started (see work_start)
+ *   operations:  counter of I/O operations (for the metadata-bound phase)
+ *   bandwidth:  counter of bytes copied (for the bandwidth-bound phase)
+ */
+void tune_start(int max_jobs, struct limit * operations, struct limit * bandwidth)
+{
+  int i;
+
+  state.counters[TUNE_METADATA] = operations;
+  state.counters[TUNE_BANDWIDTH] = bandwidth;
+  for (i = 0; i < TUNE_PHASE_COUNT; ++i)
+  {
+    state.phases[i].jobs = (max_jobs < TUNE_START_JOBS) ? max_jobs : TUNE_START_JOBS;
+    state.phases[i].rate = 0;
+    state.phases[i].steady = state.phases[i].raised = 0;
+  }
+  state.max_jobs = max_jobs;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Begin (or resume) a phase, using the number of threads that it was last tuned to.  (This must be called
+ * before work_run, not during it.)
+ *   phase:  phase (TUNE_METADATA or TUNE_BANDWIDTH)
+ */
+void tune_phase(int phase)
+{
+  if (!state.max_jobs) return;
+  state.phase = phase;
+  state.total = state.counters[phase]->total;
+  state.last = limit_clock();
+  state.next = state.last + TUNE_INTERVAL;
+  work_limit(WORK_LIMIT_TUNE, state.phases[phase].jobs);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * If it is time, sample the throughput of the current phase (and adjust the number of threads accordingly).  This is
+ * meant to be called often, by any thread; it does nothing (but check the time) unless tuning was started, and it is
+ * time for a sample, and no other thread has beaten this one to it.
+ */
+void tune_check(void)
+{
+  struct tuning * p = &state.phases[state.phase];
+  long long now, next, total;
+  double rate;
+  int jobs = p->jobs;
+
+  /* Make sure that it is time to take a sample (and that this is the only thread to take it). */
+  if (!state.max_jobs || (now = limit_clock()) < (next = state.next) || !ATOMIC_SWAP(&state.next, next, now + TUNE_INTERVAL)) return;
+
+  /* Determine the throughput since the last sample. */
+  total = state.counters[state.phase]->total;
+  rate = (total - state.total) * 1e9 / (now - state.last);
+  state.total = total;
+  state.last = now;
+
+  /* Decide how many threads to use from now on. */
+  if (tune_adjust(p, rate, state.max_jobs) != jobs) work_limit(WORK_LIMIT_TUNE, p->jobs);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Adjust a number of threads, given a new sample of the throughput they achieved (see above).
+ *   tuning:  tuning to adjust (whose jobs member receives the new number of threads)
+ *   rate:  throughput (units per second) since the last sample
+ *   max_jobs:  maximum number of threads
+ * Return Value:  New number of threads.
+ */
+int tune_adjust(struct tuning * tuning, double rate, int max_jobs)
+{
+  int jobs = tuning->jobs;
+
+  if (tuning->raised && rate <= tuning->rate * (1 + TUNE_MARGIN)) --jobs;
+  else if (rate > tuning->rate * (1 + TUNE_MARGIN)) ++jobs;
+  else if (rate < tuning->rate * (1 - TUNE_MARGIN)) jobs = (jobs * 3 / 4 < jobs - 1) ? jobs * 3 / 4 : jobs - 1;
+  else if (++tuning->steady >= TUNE_PROBE) ++jobs;
+  if (jobs > max_jobs) jobs = max_jobs;
+  if (jobs < 1) jobs = 1;
+  if (jobs != tuning->jobs) tuning->steady = 0;
+  tuning->raised = (jobs > tuning->jobs);
+  tuning->rate = rate;
+  return tuning->jobs = jobs;
+}
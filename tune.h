@@ -0,0 +1,72 @@
+/* tune.h - concurrency tuning functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _TUNE_H_
+#define _TUNE_H_
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#include "limit.h"  /* (struct) limit */
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Number of threads started (and initially used) when the number of jobs is tuned automatically */
+#define TUNE_MAX_JOBS    32
+#define TUNE_START_JOBS  4
+
+/* Time (in nanoseconds) between samples of throughput */
+#define TUNE_INTERVAL 500000000LL  /* 0.5 second */
+
+/* Fraction by which throughput must change to be considered significant */
+#define TUNE_MARGIN 0.05
+
+/* Number of samples without a significant change after which to probe one more thread */
+#define TUNE_PROBE 4
+
+/* Phases of a sync, which are tuned separately: metadata-bound (comparing and deleting) or bandwidth-bound (copying) */
+#define TUNE_METADATA   0
+#define TUNE_BANDWIDTH  1
+#define TUNE_PHASE_COUNT 2
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Tuning of a number of threads (for one phase, or one device) */
+struct tuning
+{
+  int jobs;      /* number of threads */
+  double rate;   /* throughput (units per second) as of the last sample */
+  int steady;    /* number of samples in a row without a significant change in throughput */
+  int raised;    /* nonzero if a thread was added at the last sample */
+};
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+void tune_start(int max_jobs, struct limit * operations, struct limit * bandwidth);
+void tune_phase(int phase);
+void tune_check(void);
+int tune_adjust(struct tuning * tuning, double rate, int max_jobs);
+
+
+#endif  /* (prevent multiple inclusion) */
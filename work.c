@@ -0,0 +1,449 @@
+/* work.c - worker thread functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/*****************
+ * Include Files *
+ *****************/
+
+#ifdef _WIN32
+#  include <windows.h>  /* CONDITION_VARIABLE, CRITICAL_SECTION, HANDLE, Interlocked*, WaitForSingleObject, ... */
+#  include <process.h>  /* _beginthreadex */
+#else
+#  include <pthread.h>  /* pthread_* */
+#endif
+#include <stdio.h>      /* perror */
+#include "work.h"       /* work_function, work_task_function, WORK_MAX_JOBS */
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+/* Portable threads, locks, condition variables, and atomic operations */
+#ifdef _WIN32
+#  define THREAD                   HANDLE
+#  define THREAD_RESULT            unsigned __stdcall
+#  define THREAD_CREATE(t, f, a)   (!((t) = (HANDLE)_beginthreadex(NULL, 0, (f), (a), 0, NULL)))
+#  define THREAD_JOIN(t)           (WaitForSingleObject((t), INFINITE), CloseHandle(t))
+#  define LOCK                     CRITICAL_SECTION
+#  define LOCK_INIT(l)             InitializeCriticalSection(&(l))
+#  define LOCK_ACQUIRE(l)          EnterCriticalSection(&(l))
+#  define LOCK_RELEASE(l)          LeaveCriticalSection(&(l))
+#  define CONDITION                CONDITION_VARIABLE
+#  define CONDITION_INIT(c)        InitializeConditionVariable(&(c))
+#  define CONDITION_WAIT(c, l)     SleepConditionVariableCS(&(c), &(l), INFINITE)
+#  define CONDITION_BROADCAST(c)   WakeAllConditionVariable(&(c))
+#  define CONDITION_SIGNAL(c)      WakeConditionVariable(&(c))
+#  define ATOMIC_CLAIM(p)          (InterlockedIncrement(p) - 1)
+#  define ATOMIC_DROP(p)           InterlockedDecrement(p)
+#  define ATOMIC_SWAP(p, old, new) (InterlockedCompareExchange((p), (new), (old)) == (old))
+#  define ATOMIC_FENCE()           MemoryBarrier()
+#else
+#  define THREAD                   pthread_t
+#  define THREAD_RESULT            void *
+#  define THREAD_CREATE(t, f, a)   pthread_create(&(t), NULL, (f), (a))
+#  define THREAD_JOIN(t)           pthread_join((t), NULL)
+#  define LOCK                     pthread_mutex_t
+#  define LOCK_INIT(l)             pthread_mutex_init(&(l), NULL)
+#  define LOCK_ACQUIRE(l)          pthread_mutex_lock(&(l))
+#  define LOCK_RELEASE(l)          pthread_mutex_unlock(&(l))
+#  define CONDITION                pthread_cond_t
+#  define CONDITION_INIT(c)        pthread_cond_init(&(c), NULL)
+#  define CONDITION_WAIT(c, l)     pthread_cond_wait(&(c), &(l))
+#  define CONDITION_BROADCAST(c)   pthread_cond_broadcast(&(c))
+#  define CONDITION_SIGNAL(c)      pthread_cond_signal(&(c))
+#  define ATOMIC_CLAIM(p)          __sync_fetch_and_add((p), 1)
+#  define ATOMIC_DROP(p)           __sync_sub_and_fetch((p), 1)
+#  define ATOMIC_SWAP(p, old, new) __sync_bool_compare_and_swap((p), (old), (new))
+#  define ATOMIC_FENCE()           __sync_synchronize()
+#endif
+
+/* Number of tasks each thread can hold in its deque (a power of two) */
+#define WORK_DEQUE_SIZE 1024
+
+
+/*********************************
+ * Private Function Declarations *
+ *********************************/
+
+THREAD_RESULT work_thread(void * number);
+void work_claim(int number);
+void work_steal(int number);
+void * work_take(int number);
+int work_ready(void);
+
+
+/**************************
+ * Structure Declarations *
+ **************************/
+
+/* Tasks held by a thread (see work_tree): a Chase-Lev deque, which the thread pushes tasks onto and pops them off of at
+ * the bottom, while other threads that run out of tasks steal them from the top, all without locking.  (It holds a fixed
+ * number of tasks; when it is full, a task is simply done right away, by the thread that adds it.)
+ */
+struct work_deque
+{
+  void * volatile tasks[WORK_DEQUE_SIZE];  /* tasks (each at the index of its position, modulo WORK_DEQUE_SIZE) */
+#ifdef _WIN32
+  volatile LONG top;                       /* position of the oldest task (the next to be stolen) */
+  volatile LONG bottom;                    /* position after the newest task (the next to be popped) */
+#else
+  volatile long top;
+  volatile long bottom;
+#endif
+};
+
+
+/*********************
+ * Private Variables *
+ *********************/
+
+/* The worker pool.  (There is only one, started by work_start and stopped by work_stop.) */
+static struct
+{
+  THREAD threads[WORK_MAX_JOBS];  /* worker threads (not counting the thread that calls work_run) */
+  int thread_count;               /* number of items in threads */
+  LOCK lock;                      /* protects the members below (except next) */
+  CONDITION start;                /* signaled when a new run begins (or the pool is stopping) */
+  CONDITION done;                 /* signaled when the last worker thread finishes a run */
+  CONDITION resume;               /* signaled when the limit is raised (or a thread finishes its share of a run) */
+  CONDITION added;                /* signaled when a task is added (or the last task of a run of tasks is done) */
+  volatile int limit;             /* number of threads (including the one that calls work_run) that may claim indices */
+  int limits[WORK_LIMIT_COUNT];   /* limit set by each controller (the lowest of which is the limit) */
+  unsigned int run;               /* incremented at the beginning of each run */
+  int busy;                       /* number of worker threads that have not yet finished the current run */
+  volatile int idle;              /* number of threads waiting for a task to be added (see work_steal) */
+  int stop;                       /* nonzero if the worker threads should exit */
+  work_function function;         /* function to call for each index of the current run (or NULL, if it is a run of tasks) */
+  work_task_function task_function; /* function to call for each task of the current run (if it is a run of tasks) */
+  void * context;                 /* context passed to function */
+#ifdef _WIN32
+  volatile LONG next;             /* next index to be claimed (atomically) */
+#else
+  volatile int next;
+#endif
+  int count;                      /* number of indices in the current run */
+#ifdef _WIN32
+  volatile LONG pending;          /* number of tasks of the current run (if it is a run of tasks) added but not yet done */
+#else
+  volatile long pending;
+#endif
+  struct work_deque deques[WORK_MAX_JOBS + 1];  /* tasks held by each thread (by number) */
+} pool;
+
+
+/*************
+ * Functions *
+ *************/
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Start the worker pool.
+ *   jobs:  total number of threads that should share each run (including the thread that calls work_run)
+ * Return Value:  Zero on success; otherwise, nonzero.
+ */
+int work_start(int jobs)
+{
+  int i;
+
+  LOCK_INIT(pool.lock);
+  CONDITION_INIT(pool.start);
+  CONDITION_INIT(pool.done);
+  CONDITION_INIT(pool.resume);
+  CONDITION_INIT(pool.added);
+
+  /* The calling thread does its share of each run, so it needs one less worker thread than there are jobs.
+   * (Each worker thread is numbered, starting with 1, so that it knows whether it is within the limit.)
+   */
+  if (--jobs > WORK_MAX_JOBS) jobs = WORK_MAX_JOBS;
+  for (i = 0; i < jobs; ++i) if (THREAD_CREATE(pool.threads[i], work_thread, (void *)(size_t)(i + 1))) { perror("thread"); break; }
+  pool.thread_count = i;
+  pool.limit = i + 1;
+  for (i = 0; i < WORK_LIMIT_COUNT; ++i) pool.limits[i] = pool.limit;
+  return i < jobs;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Call a function once for each index in a range, sharing the calls among the worker threads (and the calling thread),
+ * and return once they have all been made.  (The function must not itself call work_run.)
+ *   function:  function to call
+ *   context:  context passed to function
+ *   count:  number of indices (0 through count - 1) for which to call function
+ */
+void work_run(work_function function, void * context, int count)
+{
+  int i;
+
+  /* If there is nothing to share (or no one to share it with), just make the calls. */
+  if (count < 2 || !pool.thread_count) { for (i = 0; i < count; ++i) function(context, i); return; }
+
+  /* Begin a new run, wake up the worker threads, and do our share. */
+  LOCK_ACQUIRE(pool.lock);
+  pool.function = function;
+  pool.task_function = NULL;
+  pool.context = context;
+  pool.count = count;
+  pool.next = 0;
+  pool.busy = pool.thread_count;
+  ++pool.run;
+  CONDITION_BROADCAST(pool.start);
+  LOCK_RELEASE(pool.lock);
+  work_claim(0);
+
+  /* Wait for the worker threads to finish their shares. */
+  LOCK_ACQUIRE(pool.lock);
+  while (pool.busy) CONDITION_WAIT(pool.done, pool.lock);
+  LOCK_RELEASE(pool.lock);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Call a function for a task, and for each task it adds (see work_add), and so on, sharing the tasks among the worker
+ * threads (and the calling thread), and return once they have all been done.  Each thread does the tasks it added itself
+ * (newest first, like recursive calls would be made), and when it has none left, steals the oldest one that another
+ * thread added (which, if the tasks are the parts of a tree, is likely the root of a big subtree).  (The function must
+ * not call work_run or work_tree.)
+ *   function:  function to call
+ *   context:  context passed to function
+ *   task:  first task
+ */
+void work_tree(work_task_function function, void * context, void * task)
+{
+  int i;
+
+  /* Begin a new run (with the first task held by the calling thread), wake up the worker threads, and do our share. */
+  LOCK_ACQUIRE(pool.lock);
+  for (i = 0; i <= pool.thread_count; ++i) pool.deques[i].top = pool.deques[i].bottom = 0;
+  pool.function = NULL;
+  pool.task_function = function;
+  pool.context = context;
+  pool.pending = 1;
+  pool.deques[0].tasks[0] = task;
+  pool.deques[0].bottom = 1;
+  pool.busy = pool.thread_count;
+  ++pool.run;
+  CONDITION_BROADCAST(pool.start);
+  LOCK_RELEASE(pool.lock);
+  work_steal(0);
+
+  /* Wait for the worker threads to finish their shares. */
+  LOCK_ACQUIRE(pool.lock);
+  while (pool.busy) CONDITION_WAIT(pool.done, pool.lock);
+  LOCK_RELEASE(pool.lock);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Add a task to the current run of tasks (from within its function; see work_tree).  If the thread holds as many tasks as
+ * it can already, the task is done right away instead.
+ *   number:  number of the thread (as passed to the function)
+ *   task:  task
+ */
+void work_add(int number, void * task)
+{
+  struct work_deque * d = &pool.deques[number];
+  long b = d->bottom;
+
+  if (b - d->top >= WORK_DEQUE_SIZE) { pool.task_function(pool.context, task, number); return; }
+  ATOMIC_CLAIM(&pool.pending);
+  d->tasks[b & (WORK_DEQUE_SIZE - 1)] = task;
+  ATOMIC_FENCE();
+  d->bottom = b + 1;
+
+  /* If any thread is waiting for a task, wake one up to steal it. */
+  ATOMIC_FENCE();
+  if (!pool.idle) return;
+  LOCK_ACQUIRE(pool.lock);
+  CONDITION_SIGNAL(pool.added);
+  LOCK_RELEASE(pool.lock);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Limit the number of threads that do the work of each run (e.g., to relieve pressure on the system).  The others wait (once
+ * they finish the index they are working on) until the limit is raised again, or until the run is over.  Each controller
+ * (identified by a WORK_LIMIT_* index) sets its own limit, and the lowest one applies.  This may be called at any time, by
+ * any thread (including, from within a work_function, the worker threads themselves).
+ *   which:  index of controller setting the limit
+ *   jobs:  number of threads (including the thread that calls work_run) that may claim indices
+ */
+void work_limit(int which, int jobs)
+{
+  int i;
+
+  LOCK_ACQUIRE(pool.lock);
+  pool.limits[which] = (jobs < 1) ? 1 : jobs;
+  for (pool.limit = pool.limits[i = 0]; ++i < WORK_LIMIT_COUNT; ) if (pool.limits[i] < pool.limit) pool.limit = pool.limits[i];
+  CONDITION_BROADCAST(pool.resume);
+  LOCK_RELEASE(pool.lock);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Stop the worker pool (waiting for each worker thread to exit).
+ */
+void work_stop(void)
+{
+  int i;
+
+  LOCK_ACQUIRE(pool.lock);
+  pool.stop = 1;
+  CONDITION_BROADCAST(pool.start);
+  LOCK_RELEASE(pool.lock);
+  for (i = 0; i < pool.thread_count; ++i) THREAD_JOIN(pool.threads[i]);
+  pool.thread_count = 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Worker thread: do a share of each run until the pool is stopped.
+ */
+THREAD_RESULT work_thread(void * number)
+{
+  unsigned int run = 0;
+
+  LOCK_ACQUIRE(pool.lock);
+  for (;;)
+  {
+    /* Wait for a new run to begin (or for the pool to be stopped). */
+    while (run == pool.run && !pool.stop) CONDITION_WAIT(pool.start, pool.lock);
+    if (pool.stop) break;
+    run = pool.run;
+
+    /* Do our share of the run, and if we're the last to finish, say so. */
+    LOCK_RELEASE(pool.lock);
+    if (pool.function) work_claim((int)(size_t)number); else work_steal((int)(size_t)number);
+    LOCK_ACQUIRE(pool.lock);
+    if (!--pool.busy) CONDITION_BROADCAST(pool.done);
+  }
+  LOCK_RELEASE(pool.lock);
+  return 0;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Claim indices of the current run one at a time (until there are none left), calling the run's function for each.
+ * (If the thread is beyond the limit, it waits until it is not, or until there are no indices left to claim.)
+ *   number:  number of the thread (0 for the thread that calls work_run)
+ */
+void work_claim(int number)
+{
+  int i;
+
+  for (;;)
+  {
+    if (number >= pool.limit)
+    {
+      LOCK_ACQUIRE(pool.lock);
+      while (number >= pool.limit && pool.next < pool.count) CONDITION_WAIT(pool.resume, pool.lock);
+      LOCK_RELEASE(pool.lock);
+    }
+    if ((i = ATOMIC_CLAIM(&pool.next)) >= pool.count) break;
+    pool.function(pool.context, i);
+  }
+
+  /* Wake up any threads waiting for the limit to be raised, since there is nothing left for them to claim. */
+  LOCK_ACQUIRE(pool.lock);
+  CONDITION_BROADCAST(pool.resume);
+  LOCK_RELEASE(pool.lock);
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Do tasks of the current run of tasks one at a time (those the thread holds, or else those stolen from other threads),
+ * until they have all been done.  (If the thread is beyond the limit, it waits until it is not, or until they have all
+ * been done; meanwhile, the tasks it holds are left for other threads to steal.)
+ *   number:  number of the thread (0 for the thread that calls work_tree)
+ */
+void work_steal(int number)
+{
+  void * task;
+
+  while (pool.pending)
+  {
+    if (number >= pool.limit)
+    {
+      LOCK_ACQUIRE(pool.lock);
+      while (number >= pool.limit && pool.pending) CONDITION_WAIT(pool.resume, pool.lock);
+      LOCK_RELEASE(pool.lock);
+      continue;
+    }
+
+    /* If there is no task to be had right now, wait (rather than spin) until one is added, or the last one is done.  (A
+     * thread that adds a task checks for waiting threads only after adding it, and this one checks for tasks only after
+     * saying it is waiting, so either that thread wakes this one up or this one finds the task.)
+     */
+    if (!(task = work_take(number)))
+    {
+      LOCK_ACQUIRE(pool.lock);
+      ++pool.idle;
+      ATOMIC_FENCE();
+      while (pool.pending && !work_ready()) CONDITION_WAIT(pool.added, pool.lock);
+      --pool.idle;
+      LOCK_RELEASE(pool.lock);
+      continue;
+    }
+    pool.task_function(pool.context, task, number);
+    if (ATOMIC_DROP(&pool.pending)) continue;
+
+    /* That was the last task, so wake up any threads waiting for a task, or for the limit to be raised. */
+    LOCK_ACQUIRE(pool.lock);
+    CONDITION_BROADCAST(pool.added);
+    CONDITION_BROADCAST(pool.resume);
+    LOCK_RELEASE(pool.lock);
+  }
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Take a task of the current run of tasks: pop the newest one the thread holds, or if it holds none, steal the oldest one
+ * another thread holds.
+ *   number:  number of the thread
+ * Return Value:  Task, or NULL if none could be taken (though there may be one by the time another attempt is made).
+ */
+void * work_take(int number)
+{
+  struct work_deque * d = &pool.deques[number];
+  void * task = NULL;
+  long b = d->bottom - 1, t;
+  int i;
+
+  /* Pop a task off the bottom of our own deque.  (Only if it is the last one might another thread be stealing it too, in
+   * which case whichever moves the top first gets it.)
+   */
+  d->bottom = b;
+  ATOMIC_FENCE();
+  if ((t = d->top) <= b)
+  {
+    task = d->tasks[b & (WORK_DEQUE_SIZE - 1)];
+    if (t < b) return task;
+    if (!ATOMIC_SWAP(&d->top, t, t + 1)) task = NULL;
+  }
+  d->bottom = b + 1;
+  if (task) return task;
+
+  /* Steal a task off the top of another thread's deque (trying each in turn, starting with the next one). */
+  for (i = 1; i <= pool.thread_count; ++i)
+  {
+    d = &pool.deques[(number + i) % (pool.thread_count + 1)];
+    t = d->top;
+    ATOMIC_FENCE();
+    if (t >= d->bottom) continue;
+    task = d->tasks[t & (WORK_DEQUE_SIZE - 1)];
+    if (ATOMIC_SWAP(&d->top, t, t + 1)) return task;
+  }
+  return NULL;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Determine whether any thread holds a task of the current run of tasks (that could be taken).
+ * Return Value:  Nonzero if a task is held; otherwise, zero.
+ */
+int work_ready(void)
+{
+  int i;
+
+  for (i = 0; i <= pool.thread_count; ++i) if (pool.deques[i].top < pool.deques[i].bottom) return 1;
+  return 0;
+}
@@ -0,0 +1,50 @@
+/* work.h - worker thread functions for Plunge
+ *
+ * Copyright (c) 2016-21 Jeffrey Paul Bourdier
+ *
+ * Licensed under the MIT License.  This file may be used only in compliance with this License.
+ * Software distributed under this License is provided "AS IS", WITHOUT WARRANTY OF ANY KIND.
+ * For more information, see the accompanying License file or the following URL:
+ *
+ *   https://opensource.org/licenses/MIT
+ */
+
+
+/* Prevent multiple inclusion. */
+#ifndef _WORK_H_
+#define _WORK_H_
+
+
+/*********************
+ * Macro Definitions *
+ *********************/
+
+#define WORK_MAX_JOBS 64
+
+/* Controllers that may limit the number of threads (see work_limit) */
+#define WORK_LIMIT_PRESSURE  0
+#define WORK_LIMIT_TUNE      1
+#define WORK_LIMIT_COUNT     2
+
+
+/********************
+ * Type Definitions *
+ ********************/
+
+typedef void (* work_function)(void * context, int index);
+typedef void (* work_task_function)(void * context, void * task, int number);
+
+
+/*************************
+ * Function Declarations *
+ *************************/
+
+int work_start(int jobs);
+void work_run(work_function function, void * context, int count);
+void work_tree(work_task_function function, void * context, void * task);
+void work_add(int number, void * task);
+void work_limit(int which, int jobs);
+void work_stop(void);
+
+
+#endif  /* (prevent multiple inclusion) */